@@ -46,7 +46,9 @@ int rezygiskd_connect(uint8_t retry) {
 
     close(fd);
 
-    if (retry) {
+    /* INFO: No point in waiting after the last attempt, and a single attempt must
+               not sleep, as Zygote connects with it right before forking. */
+    if (retry > 1) {
       PLOGE("Failed to connect to ReZygiskd, retrying...");
 
       sleep(1);
@@ -90,18 +92,22 @@ bool rezygiskd_zygote_injected() {
   return true;
 }
 
-uint32_t rezygiskd_get_process_flags(uid_t uid, const char *const process) {
+int rezygiskd_request_process_flags(uid_t uid, const char *const process) {
   int fd = rezygiskd_connect(1);
   if (fd == -1) {
     PLOGE("connection to ReZygiskd");
 
-    return 0;
+    return -1;
   }
 
-  safe_write(write_uint8_t(fd, (uint8_t)GetProcessFlags), "GetProcessFlags action", return 0);
-  safe_write(write_uint32_t(fd, (uint32_t)uid), "uid", return 0);
-  safe_write(write_string(fd, process), "process name", return 0);
+  safe_write(write_uint8_t(fd, (uint8_t)GetProcessFlags), "GetProcessFlags action", return -1);
+  safe_write(write_uint32_t(fd, (uint32_t)uid), "uid", return -1);
+  safe_write(write_string(fd, process), "process name", return -1);
 
+  return fd;
+}
+
+uint32_t rezygiskd_read_process_flags(int fd) {
   uint32_t res = 0;
   safe_read(read_uint32_t(fd, &res), "process flags", return 0);
 
@@ -110,6 +116,13 @@ uint32_t rezygiskd_get_process_flags(uid_t uid, const char *const process) {
   return res;
 }
 
+uint32_t rezygiskd_get_process_flags(uid_t uid, const char *const process) {
+  int fd = rezygiskd_request_process_flags(uid, process);
+  if (fd == -1) return 0;
+
+  return rezygiskd_read_process_flags(fd);
+}
+
 void rezygiskd_get_info(struct rezygisk_info *info) {
   int fd = rezygiskd_connect(1);
   if (fd == -1) {
@@ -247,9 +260,15 @@ bool rezygiskd_read_modules(struct zygisk_modules *modules) {
   safe_read(read_size_t(fd, &len), "modules count", return false);
 
   modules->modules = malloc(len * sizeof(char *));
-  if (!modules->modules) {
+  modules->targets = calloc(len, sizeof(char *));
+  if (!modules->modules || !modules->targets) {
     PLOGE("allocating modules name memory");
 
+    free(modules->modules);
+    modules->modules = NULL;
+    free(modules->targets);
+    modules->targets = NULL;
+
     close(fd);
 
     return false;
@@ -270,6 +289,18 @@ bool rezygiskd_read_modules(struct zygisk_modules *modules) {
     }
 
     modules->modules[i] = lib_path;
+
+    uint8_t has_targets = 0;
+    if (read_uint8_t(fd, &has_targets) == -1 || (has_targets && !(modules->targets[i] = read_string(fd)))) {
+      PLOGE("reading module targets");
+
+      modules->modules_count = i + 1;
+      free_modules(modules);
+
+      close(fd);
+
+      return false;
+    }
   }
 
   close(fd);
@@ -280,10 +311,13 @@ bool rezygiskd_read_modules(struct zygisk_modules *modules) {
 void free_modules(struct zygisk_modules *modules) {
   for (size_t i = 0; i < modules->modules_count; i++) {
     free(modules->modules[i]);
+    free(modules->targets[i]);
   }
 
   free(modules->modules);
   modules->modules = NULL;
+  free(modules->targets);
+  modules->targets = NULL;
   modules->modules_count = 0;
 }
 
@@ -374,7 +408,7 @@ bool rezygiskd_update_mns(enum mount_namespace_state nms_state, char *buf, size_
   return true;
 }
 
-bool rezygiskd_remove_module(size_t index) {
+bool rezygiskd_remove_modules(const size_t *indices, size_t indices_count) {
   int fd = rezygiskd_connect(1);
   if (fd == -1) {
     PLOGE("connection to ReZygiskd");
@@ -383,7 +417,10 @@ bool rezygiskd_remove_module(size_t index) {
   }
 
   safe_write(write_uint8_t(fd, (uint8_t)RemoveModule), "RemoveModule action", return false);
-  safe_write(write_size_t(fd, index), "module index", return false);
+  safe_write(write_size_t(fd, indices_count), "module indices count", return false);
+  for (size_t i = 0; i < indices_count; i++) {
+    safe_write(write_size_t(fd, indices[i]), "module index", return false);
+  }
 
   uint8_t res = 0;
   safe_read(read_uint8_t(fd, &res), "remove module result", return false);
@@ -393,5 +430,210 @@ bool rezygiskd_remove_module(size_t index) {
   return res == 1;
 }
 
+static bool read_stat(int fd, struct rezygiskd_stat *entry, uint32_t buckets_count) {
+  if (read_uint64_t(fd, &entry->count) == -1 || read_uint64_t(fd, &entry->total_us) == -1 ||
+      read_uint64_t(fd, &entry->max_us) == -1 ||
+      read_loop(fd, entry->buckets, buckets_count * sizeof(uint32_t)) == -1) {
+    LOGE("Failed to read stats of %s from ReZygiskd", entry->name);
+
+    return false;
+  }
+
+  return true;
+}
+
+bool rezygiskd_get_stats(struct rezygiskd_stats *stats) {
+  stats->entries = NULL;
+  stats->entries_count = 0;
+  stats->module_entries = NULL;
+  stats->module_entries_count = 0;
+  stats->buckets_count = 0;
+
+  int fd = rezygiskd_connect(1);
+  if (fd == -1) {
+    PLOGE("connection to ReZygiskd");
+
+    return false;
+  }
+
+  safe_write(write_uint8_t(fd, (uint8_t)GetStats), "GetStats action", return false);
+
+  uint32_t entries_count = 0;
+  safe_read(read_uint32_t(fd, &entries_count), "stats events count", return false);
+  safe_read(read_uint32_t(fd, &stats->buckets_count), "stats buckets count", return false);
+
+  if (stats->buckets_count > REZYGISKD_STATS_MAX_BUCKETS) {
+    LOGE("Too many stats buckets from ReZygiskd: %u", stats->buckets_count);
+
+    close(fd);
+
+    return false;
+  }
+
+  stats->entries = (struct rezygiskd_stat *)calloc(entries_count, sizeof(struct rezygiskd_stat));
+  if (!stats->entries) {
+    PLOGE("allocating stats memory");
+
+    close(fd);
+
+    return false;
+  }
+
+  for (uint32_t i = 0; i < entries_count; i++) {
+    struct rezygiskd_stat *entry = &stats->entries[i];
+
+    entry->name = read_string(fd);
+    if (!entry->name) {
+      PLOGE("reading stats event name");
+
+      goto stats_cleanup;
+    }
+
+    stats->entries_count = i + 1;
+
+    if (!read_stat(fd, entry, stats->buckets_count)) goto stats_cleanup;
+  }
+
+  uint32_t module_entries_count = 0;
+  if (read_uint32_t(fd, &module_entries_count) == -1) {
+    PLOGE("reading module stats count");
+
+    goto stats_cleanup;
+  }
+
+  if (module_entries_count != 0) {
+    stats->module_entries = (struct rezygiskd_stat *)calloc(module_entries_count, sizeof(struct rezygiskd_stat));
+    if (!stats->module_entries) {
+      PLOGE("allocating module stats memory");
+
+      goto stats_cleanup;
+    }
+  }
+
+  for (uint32_t i = 0; i < module_entries_count; i++) {
+    struct rezygiskd_stat *entry = &stats->module_entries[i];
+
+    entry->name = read_string(fd);
+    if (!entry->name) {
+      PLOGE("reading module stats name");
+
+      goto stats_cleanup;
+    }
+
+    stats->module_entries_count = i + 1;
+
+    if (!read_stat(fd, entry, stats->buckets_count)) goto stats_cleanup;
+  }
+
+  close(fd);
+
+  return true;
+
+  stats_cleanup:
+    free_rezygiskd_stats(stats);
+
+    close(fd);
+
+    return false;
+}
+
+void free_rezygiskd_stats(struct rezygiskd_stats *stats) {
+  for (size_t i = 0; i < stats->entries_count; i++) {
+    free(stats->entries[i].name);
+  }
+
+  free(stats->entries);
+  stats->entries = NULL;
+  stats->entries_count = 0;
+
+  for (size_t i = 0; i < stats->module_entries_count; i++) {
+    free(stats->module_entries[i].name);
+  }
+
+  free(stats->module_entries);
+  stats->module_entries = NULL;
+  stats->module_entries_count = 0;
+}
+
+int rezygiskd_get_trace_buffer(void) {
+  int fd = rezygiskd_connect(1);
+  if (fd == -1) {
+    PLOGE("connection to ReZygiskd");
+
+    return -1;
+  }
+
+  safe_write(write_uint8_t(fd, (uint8_t)GetTraceBuffer), "GetTraceBuffer action", return -1);
+
+  uint8_t enabled = 0;
+  safe_read(read_uint8_t(fd, &enabled), "trace buffer state", return -1);
+
+  if (!enabled) {
+    close(fd);
+
+    return -1;
+  }
+
+  int trace_fd = read_fd(fd);
+
+  close(fd);
+
+  return trace_fd;
+}
+
+int rezygiskd_get_module_stats_buffer(void) {
+  int fd = rezygiskd_connect(1);
+  if (fd == -1) {
+    PLOGE("connection to ReZygiskd");
+
+    return -1;
+  }
+
+  safe_write(write_uint8_t(fd, (uint8_t)GetModuleStatsBuffer), "GetModuleStatsBuffer action", return -1);
+
+  uint8_t available = 0;
+  safe_read(read_uint8_t(fd, &available), "module stats buffer state", return -1);
+
+  if (!available) {
+    close(fd);
+
+    return -1;
+  }
+
+  int module_stats_fd = read_fd(fd);
+
+  close(fd);
+
+  return module_stats_fd;
+}
+
+int rezygiskd_get_module_relro(size_t index, uint8_t *role) {
+  *role = 0;
+
+  int fd = rezygiskd_connect(1);
+  if (fd == -1) {
+    PLOGE("connection to ReZygiskd");
+
+    return -1;
+  }
+
+  safe_write(write_uint8_t(fd, (uint8_t)GetModuleRelro), "GetModuleRelro action", return -1);
+  safe_write(write_size_t(fd, index), "module index", return -1);
+
+  safe_read(read_uint8_t(fd, role), "module RELRO role", return -1);
+
+  if (*role == 0) {
+    close(fd);
+
+    return -1;
+  }
+
+  int relro_fd = read_fd(fd);
+
+  close(fd);
+
+  return relro_fd;
+}
+
 #undef safe_read
 #undef safe_write
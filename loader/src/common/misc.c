@@ -2,18 +2,19 @@
 #include <stdlib.h>
 #include <signal.h>
 #include <sched.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
-#include <sys/socket.h>
 #include <sys/sysmacros.h>
 #include <sys/utsname.h>
 #include <sys/wait.h>
 #include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 
 #include <unistd.h>
 
 #include "logging.h"
-#include "socket_utils.h"
 
 #include "misc.h"
 
@@ -50,217 +51,420 @@ struct kernel_version parse_kversion() {
   return version;
 }
 
-/* INFO: Opening /proc/.../maps leads to its access time being updated. This
-           function bypasses this by reading the maps from a forked process,
-           which is the same memory topology anyway. See more information in
-           parse_maps().
-*/
-struct maps_info *parse_maps_safe(const char *pid) {
-  int sockets[2];
-  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0) {
-    LOGE("Failed to create socket pair");
+static struct maps_info *maps_info_alloc(size_t *capacity) {
+  struct maps_info *info_array = calloc(1, sizeof(struct maps_info));
+  if (!info_array) {
+    PLOGE("allocate memory");
 
     return NULL;
   }
 
-  int ppid = clone(NULL, NULL, SIGCHLD, NULL);
-  if (ppid == -1) {
-    LOGE("Failed to clone process");
+  *capacity = 2;
+  info_array->maps = malloc(*capacity * sizeof(struct map_entry));
+  if (!info_array->maps) {
+    PLOGE("allocate memory for maps");
 
-    close(sockets[0]);
-    close(sockets[1]);
+    free(info_array);
 
     return NULL;
   }
+  info_array->length = 0;
 
-  if (ppid == 0) {
-    close(sockets[0]);
+  return info_array;
+}
 
-    char path[64];
-    snprintf(path, sizeof(path), "/proc/%s/maps", pid);
+/* INFO: Takes ownership of "entry->path", freeing it on failure */
+static bool maps_info_add(struct maps_info *info_array, size_t *capacity, const struct map_entry *entry) {
+  if (info_array->length >= *capacity) {
+    struct map_entry *tmp_maps = realloc(info_array->maps, *capacity * 2 * sizeof(struct map_entry));
+    if (!tmp_maps) {
+      PLOGE("reallocate memory for maps");
 
-    int maps_file = open(path, O_RDONLY | O_CLOEXEC);
-    if (maps_file < 0) {
-      LOGE("Failed to open %s", path);
+      free(entry->path);
 
-      uint8_t can_kill_myself = 0;
-      if (TEMP_FAILURE_RETRY(write(sockets[1], &can_kill_myself, sizeof(can_kill_myself))) < 0) {
-        LOGE("Failed to write to socket");
-      }
-
-      goto scan_children_fail;
+      return false;
     }
 
-    if (write_fd(sockets[1], maps_file) < 0) {
-      LOGE("Failed to write file descriptor to socket");
+    info_array->maps = tmp_maps;
+    *capacity *= 2;
+  }
 
-      goto post_open_scan_children_fail;
-    }
+  info_array->maps[info_array->length++] = *entry;
 
-    /* INFO: Wait for the parent process to finish reading */
-    uint8_t can_kill_myself = 1;
-    if (TEMP_FAILURE_RETRY(read(sockets[1], &can_kill_myself, sizeof(can_kill_myself))) < 0) {
-      LOGE("Failed to read from socket");
+  return true;
+}
 
-      goto post_open_scan_children_fail;
-    }
+static void maps_info_shrink(struct maps_info *info_array) {
+  /* INFO: Resize to the actual size */
+  struct map_entry *tmp_maps = realloc(info_array->maps, info_array->length * sizeof(struct map_entry));
+  if (!tmp_maps)
+    PLOGE("reallocate memory for maps");
 
-    close(maps_file);
-    close(sockets[1]);
+  if (tmp_maps) info_array->maps = tmp_maps;
+}
 
-    _exit(EXIT_SUCCESS);
+/* INFO: Parses a single line of /proc/.../maps, without its trailing new line.
+           Returns false only on allocation failure, not on malformed lines. */
+static bool parse_maps_line(char *line, struct maps_info *info_array, size_t *capacity) {
+  uintptr_t start, end, offset;
+  unsigned int dev_major, dev_minor;
+  ino_t inode;
+  char perms[5] = { 0 };
+  int path_off;
+
+  if (sscanf(line, "%" PRIxPTR "-%" PRIxPTR " %4s %" PRIxPTR " %x:%x %lu %n",
+             &start, &end, perms, &offset, &dev_major, &dev_minor, &inode, &path_off) != 7) {
+    return true;
+  }
 
-    post_open_scan_children_fail:
-      close(maps_file);
-    scan_children_fail:
-      close(sockets[1]);
+  uint8_t perms_bit = 0;
+  if (perms[0] == 'r') perms_bit |= PROT_READ;
+  if (perms[1] == 'w') perms_bit |= PROT_WRITE;
+  if (perms[2] == 'x') perms_bit |= PROT_EXEC;
 
-      _exit(EXIT_FAILURE);
-  }
+  while (isspace((unsigned char)line[path_off]))
+    path_off++;
 
-  close(sockets[1]);
+  char *path_str = strdup(line + path_off);
+  if (!path_str) {
+    PLOGE("allocate memory for map path");
 
-  int fd = read_fd(sockets[0]);
-  if (fd < 0) {
-    LOGE("Failed to read file descriptor from socket");
+    return false;
+  }
 
-    close(sockets[0]);
+  struct map_entry new_map = {
+    .start = start,
+    .end = end,
+    .perms = perms_bit,
+    .is_private = (perms[3] == 'p'),
+    .offset = offset,
+    .dev = makedev(dev_major, dev_minor),
+    .inode = inode,
+    .path = path_str
+  };
+
+  return maps_info_add(info_array, capacity, &new_map);
+}
 
-    return NULL;
+/* INFO: PROCMAP_QUERY (Linux 6.11+) returns one VMA per ioctl, without formatting
+           nor parsing text. Defined here as the NDK headers may predate it. */
+#ifndef PROCMAP_QUERY
+  #define PROCMAP_QUERY _IOWR('f', 17, struct procmap_query)
+
+  #define PROCMAP_QUERY_VMA_READABLE 0x01
+  #define PROCMAP_QUERY_VMA_WRITABLE 0x02
+  #define PROCMAP_QUERY_VMA_EXECUTABLE 0x04
+  #define PROCMAP_QUERY_VMA_SHARED 0x08
+  #define PROCMAP_QUERY_COVERING_OR_NEXT_VMA 0x10
+
+  struct procmap_query {
+    uint64_t size;
+    uint64_t query_flags;
+    uint64_t query_addr;
+    uint64_t vma_start;
+    uint64_t vma_end;
+    uint64_t vma_flags;
+    uint64_t vma_page_size;
+    uint64_t vma_offset;
+    uint64_t inode;
+    uint32_t dev_major;
+    uint32_t dev_minor;
+    uint32_t vma_name_size;
+    uint32_t build_id_size;
+    uint64_t vma_name_addr;
+    uint64_t build_id_addr;
+  };
+#endif
+
+enum procmap_query_support {
+  PROCMAP_QUERY_UNKNOWN,
+  PROCMAP_QUERY_SUPPORTED,
+  PROCMAP_QUERY_UNSUPPORTED
+};
+
+static int self_maps_fd = -1;
+static pid_t self_maps_pid = 0;
+static enum procmap_query_support procmap_query_support = PROCMAP_QUERY_UNKNOWN;
+
+#define SELF_MAPS_OPENER_STACK_SIZE (64 * 1024)
+
+struct self_maps_opener_args {
+  const char *path;
+  int fd;
+
+  /* INFO: When set, the helper reads the whole text into it instead of keeping the fd */
+  char *buf;
+  size_t buf_capacity;
+  size_t buf_len;
+  bool truncated;
+};
+
+/* INFO: Runs on a small stack while we are suspended, so it only makes syscalls */
+static int self_maps_opener(void *arg) {
+  struct self_maps_opener_args *args = (struct self_maps_opener_args *)arg;
+
+  int fd = open(args->path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1 || !args->buf) {
+    args->fd = fd;
+
+    return 0;
   }
 
-  FILE *fp = fdopen(fd, "r");
-  if (!fp) {
-    LOGE("Failed to open file descriptor as FILE");
+  args->truncated = true;
+  while (args->buf_len < args->buf_capacity - 1) {
+    ssize_t read_bytes = TEMP_FAILURE_RETRY(read(fd, args->buf + args->buf_len, args->buf_capacity - args->buf_len - 1));
+    if (read_bytes == -1) {
+      close(fd);
 
-    close(fd);
-    close(sockets[0]);
+      return 0;
+    }
 
-    return NULL;
+    if (read_bytes == 0) {
+      args->truncated = false;
+
+      break;
+    }
+
+    args->buf_len += (size_t)read_bytes;
   }
 
-  struct maps_info *info_array = calloc(1, sizeof(struct maps_info));
-  if (!info_array) {
-    PLOGE("allocate memory");
+  close(fd);
 
-    close(fd);
-    close(sockets[0]);
+  /* INFO: Only tells that the text was read, the fd is already closed */
+  args->fd = 0;
 
-    return NULL;
+  return 0;
+}
+
+/* INFO: Opening /proc/self/maps leads to its access time being updated, see
+           parse_maps(), and so does opening smaps. The file is therefore opened
+           by a task that shares our memory and fd table (CLONE_VM | CLONE_FILES),
+           so that it describes our own address space while only the helper's
+           /proc entry is touched. Unlike a fork, this copies no page tables. */
+static bool self_maps_run_opener(struct self_maps_opener_args *args) {
+  void *stack = mmap(NULL, SELF_MAPS_OPENER_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (stack == MAP_FAILED) {
+    PLOGE("allocate stack for maps opener");
+
+    return false;
   }
 
-  size_t infos_capacity = 2;
-  info_array->maps = malloc(infos_capacity * sizeof(struct map_entry));
-  if (!info_array->maps) {
-    PLOGE("allocate memory for maps");
+  args->fd = -1;
+  pid_t pid = clone(self_maps_opener, (char *)stack + SELF_MAPS_OPENER_STACK_SIZE, CLONE_VM | CLONE_FILES | CLONE_VFORK | SIGCHLD, args);
+  if (pid == -1) {
+    PLOGE("clone maps opener");
 
-    free(info_array);
+    munmap(stack, SELF_MAPS_OPENER_STACK_SIZE);
 
-    close(fd);
-    close(sockets[0]);
+    return false;
+  }
 
-    return NULL;
+  waitpid(pid, NULL, 0);
+  munmap(stack, SELF_MAPS_OPENER_STACK_SIZE);
+
+  if (args->fd == -1) {
+    LOGE("Failed to open %s", args->path);
+
+    return false;
   }
-  info_array->length = 0;
 
-  char line[1024];
-  while (fgets(line, sizeof(line), fp) != NULL) {
-    line[strlen(line) - 1] = '\0';
+  return true;
+}
 
-    uintptr_t start, end, offset;
-    unsigned int dev_major, dev_minor;
-    ino_t inode;
-    char perms[5] = { 0 };
-    int path_off;
+/* INFO: The fd is kept for PROCMAP_QUERY, which works on the memory it pinned when
+           opened, even once the helper is gone. Reading the text of a dead task's
+           maps fails, so parse_maps_self_text() gets its own helper every time. */
+static bool self_maps_open(void) {
+  if (self_maps_fd != -1 && self_maps_pid == getpid()) return true;
 
-    if (sscanf(line, "%" PRIxPTR "-%" PRIxPTR " %4s %" PRIxPTR " %x:%x %lu %n",
-               &start, &end, perms, &offset, &dev_major, &dev_minor, &inode, &path_off) != 7) {
-      continue;
-    }
+  /* INFO: Inherited from the parent, so it describes the parent's memory */
+  if (self_maps_fd != -1) close(self_maps_fd);
+  self_maps_fd = -1;
 
-    uint8_t perms_bit = 0;
-    if (perms[0] == 'r') perms_bit |= PROT_READ;
-    if (perms[1] == 'w') perms_bit |= PROT_WRITE;
-    if (perms[2] == 'x') perms_bit |= PROT_EXEC;
+  struct self_maps_opener_args args = { 0 };
+  args.path = "/proc/self/maps";
+  if (!self_maps_run_opener(&args)) return false;
 
-    while (isspace((unsigned char)line[path_off]))
-      path_off++;
+  self_maps_fd = args.fd;
+  self_maps_pid = getpid();
 
-    char *path_str = strdup(line + path_off);
-    if (!path_str) {
-      PLOGE("allocate memory for map path");
+  return true;
+}
 
-      goto cleanup_maps;
-    }
+void parse_maps_self_close(void) {
+  if (self_maps_fd == -1) return;
+
+  close(self_maps_fd);
+  self_maps_fd = -1;
+  self_maps_pid = 0;
+}
+
+static struct maps_info *parse_maps_self_query(void) {
+  size_t infos_capacity;
+  struct maps_info *info_array = maps_info_alloc(&infos_capacity);
+  if (!info_array) return NULL;
+
+  char name[PATH_MAX];
+  uint64_t addr = 0;
+  while (1) {
+    struct procmap_query query = {
+      .size = sizeof(query),
+      .query_flags = PROCMAP_QUERY_COVERING_OR_NEXT_VMA,
+      .query_addr = addr,
+      .vma_name_size = sizeof(name),
+      .vma_name_addr = (uint64_t)(uintptr_t)name
+    };
 
-    if (info_array->length >= infos_capacity) {
-      infos_capacity *= 2;
-      struct map_entry *tmp_maps = realloc(info_array->maps, infos_capacity * sizeof(struct map_entry));
-      if (!tmp_maps) {
-        PLOGE("reallocate memory for maps");
+    if (ioctl(self_maps_fd, PROCMAP_QUERY, &query) == -1) {
+      /* INFO: No VMA at or after "addr", which is the end of the list */
+      if (errno == ENOENT) break;
 
-        goto cleanup_maps_and_path;
+      if (procmap_query_support == PROCMAP_QUERY_UNKNOWN && (errno == ENOTTY || errno == EINVAL)) {
+        procmap_query_support = PROCMAP_QUERY_UNSUPPORTED;
+      } else {
+        PLOGE("query maps at %" PRIx64, addr);
       }
-      info_array->maps = tmp_maps;
+
+      free_maps(info_array);
+
+      return NULL;
+    }
+
+    procmap_query_support = PROCMAP_QUERY_SUPPORTED;
+
+    char *path_str = strdup(query.vma_name_size != 0 ? name : "");
+    if (!path_str) {
+      PLOGE("allocate memory for map path");
+
+      free_maps(info_array);
+
+      return NULL;
     }
 
+    uint8_t perms_bit = 0;
+    if (query.vma_flags & PROCMAP_QUERY_VMA_READABLE) perms_bit |= PROT_READ;
+    if (query.vma_flags & PROCMAP_QUERY_VMA_WRITABLE) perms_bit |= PROT_WRITE;
+    if (query.vma_flags & PROCMAP_QUERY_VMA_EXECUTABLE) perms_bit |= PROT_EXEC;
+
     struct map_entry new_map = {
-      .start = start,
-      .end = end,
+      .start = (uintptr_t)query.vma_start,
+      .end = (uintptr_t)query.vma_end,
       .perms = perms_bit,
-      .is_private = (perms[3] == 'p'),
-      .offset = offset,
-      .dev = makedev(dev_major, dev_minor),
-      .inode = inode,
+      .is_private = !(query.vma_flags & PROCMAP_QUERY_VMA_SHARED),
+      .offset = (uintptr_t)query.vma_offset,
+      .dev = makedev(query.dev_major, query.dev_minor),
+      .inode = (ino_t)query.inode,
       .path = path_str
     };
 
-    info_array->maps[info_array->length++] = new_map;
+    if (!maps_info_add(info_array, &infos_capacity, &new_map)) {
+      free_maps(info_array);
 
-    continue;
+      return NULL;
+    }
 
-    cleanup_maps_and_path:
-      free(path_str);
-    cleanup_maps:
-      for (size_t i = 0; i < info_array->length; i++) {
-        free(info_array->maps[i].path);
-      }
-      free(info_array->maps);
-      free(info_array);
+    addr = query.vma_end;
+  }
 
-      fclose(fp);
-      close(sockets[0]);
+  maps_info_shrink(info_array);
 
-      waitpid(ppid, NULL, 0);
+  return info_array;
+}
+
+char *read_self_proc_file(const char *path, size_t *capacity, size_t *len) {
+  /* INFO: The helper cannot allocate, so it is run again with a bigger buffer
+             until the whole text fits. */
+  struct self_maps_opener_args args = { 0 };
+  args.path = path;
+  args.buf_capacity = *capacity;
+
+  while (1) {
+    args.buf = malloc(args.buf_capacity);
+    if (!args.buf) {
+      PLOGE("allocate memory for %s", path);
+
+      return NULL;
+    }
+
+    args.buf_len = 0;
+    args.truncated = false;
+
+    if (!self_maps_run_opener(&args)) {
+      free(args.buf);
 
       return NULL;
+    }
+
+    if (!args.truncated) break;
+
+    free(args.buf);
+    args.buf_capacity *= 2;
   }
 
-  fclose(fp);
+  *capacity = args.buf_capacity;
+
+  args.buf[args.buf_len] = '\0';
+  *len = args.buf_len;
+
+  return args.buf;
+}
+
+/* INFO: Capacity the maps text last fit in. Zygote and its children usually have
+           150-400 KiB of maps, and they change little between parses, so starting
+           from it avoids running the helper again for a bigger buffer. */
+static size_t self_maps_text_capacity = 256 * 1024;
 
-  /* INFO: Notify the children process that we are done */
-  uint8_t can_kill_itself = 1;
-  if (TEMP_FAILURE_RETRY(write(sockets[0], &can_kill_itself, sizeof(can_kill_itself))) < 0) {
-    LOGE("Failed to write to socket");
+static struct maps_info *parse_maps_self_text(void) {
+  size_t buf_len;
+  char *buf = read_self_proc_file("/proc/self/maps", &self_maps_text_capacity, &buf_len);
+  if (!buf) return NULL;
 
-    goto cleanup_maps;
+  size_t infos_capacity;
+  struct maps_info *info_array = maps_info_alloc(&infos_capacity);
+  if (!info_array) {
+    free(buf);
+
+    return NULL;
   }
 
-  close(sockets[0]);
+  char *line = buf;
+  while (*line) {
+    char *line_end = strchr(line, '\n');
+    if (line_end) *line_end = '\0';
 
-  /* INFO: Resize to the actual size */
-  struct map_entry *tmp_maps = realloc(info_array->maps, info_array->length * sizeof(struct map_entry));
-  if (!tmp_maps)
-    PLOGE("reallocate memory for maps");
+    if (!parse_maps_line(line, info_array, &infos_capacity)) {
+      free_maps(info_array);
+      free(buf);
 
-  if (tmp_maps) info_array->maps = tmp_maps;
-  /* INFO: This waitpid ensures that we only resume code execution once the child dies,
-            or the child process will become zombie as shown in /proc/<child_pid>/status */
-  waitpid(ppid, NULL, 0);
+      return NULL;
+    }
+
+    if (!line_end) break;
+
+    line = line_end + 1;
+  }
+
+  free(buf);
+
+  maps_info_shrink(info_array);
 
   return info_array;
 }
 
+struct maps_info *parse_maps_self(void) {
+  if (procmap_query_support != PROCMAP_QUERY_UNSUPPORTED) {
+    if (!self_maps_open()) return NULL;
+
+    struct maps_info *info_array = parse_maps_self_query();
+    if (info_array || procmap_query_support == PROCMAP_QUERY_SUPPORTED) return info_array;
+
+    /* INFO: Useless to the text path */
+    parse_maps_self_close();
+  }
+
+  return parse_maps_self_text();
+}
+
 /* INFO: Accessing /proc/.../maps will update its access time. This is detectable
            by using stat() to check when the application takes control of the
            execution of the process. However, if we do this before the fork(),
@@ -279,105 +483,29 @@ struct maps_info *parse_maps(const char *pid) {
     return NULL;
   }
 
-  struct maps_info *info_array = calloc(1, sizeof(struct maps_info));
+  size_t infos_capacity;
+  struct maps_info *info_array = maps_info_alloc(&infos_capacity);
   if (!info_array) {
-    PLOGE("allocate memory");
-
-    fclose(fp);
-
-    return NULL;
-  }
-
-  size_t infos_capacity = 2;
-  info_array->maps = malloc(infos_capacity * sizeof(struct map_entry));
-  if (!info_array->maps) {
-    PLOGE("allocate memory for maps");
-
-    free(info_array);
     fclose(fp);
 
     return NULL;
   }
-  info_array->length = 0;
 
   char line[1024];
   while (fgets(line, sizeof(line), fp) != NULL) {
     line[strlen(line) - 1] = '\0';
 
-    uintptr_t start, end, offset;
-    unsigned int dev_major, dev_minor;
-    ino_t inode;
-    char perms[5] = { 0 };
-    int path_off;
-
-    if (sscanf(line, "%" PRIxPTR "-%" PRIxPTR " %4s %" PRIxPTR " %x:%x %lu %n",
-               &start, &end, perms, &offset, &dev_major, &dev_minor, &inode, &path_off) != 7) {
-      continue;
-    }
-
-    uint8_t perms_bit = 0;
-    if (perms[0] == 'r') perms_bit |= PROT_READ;
-    if (perms[1] == 'w') perms_bit |= PROT_WRITE;
-    if (perms[2] == 'x') perms_bit |= PROT_EXEC;
-
-    while (isspace((unsigned char)line[path_off]))
-      path_off++;
-
-    char *path_str = strdup(line + path_off);
-    if (!path_str) {
-      PLOGE("allocate memory for map path");
-
-      goto cleanup_maps;
-    }
-
-    if (info_array->length >= infos_capacity) {
-      infos_capacity *= 2;
-      struct map_entry *tmp_maps = realloc(info_array->maps, infos_capacity * sizeof(struct map_entry));
-      if (!tmp_maps) {
-        PLOGE("reallocate memory for maps");
-
-        goto cleanup_maps_and_path;
-      }
-      info_array->maps = tmp_maps;
-    }
-
-    struct map_entry new_map = {
-      .start = start,
-      .end = end,
-      .perms = perms_bit,
-      .is_private = (perms[3] == 'p'),
-      .offset = offset,
-      .dev = makedev(dev_major, dev_minor),
-      .inode = inode,
-      .path = path_str
-    };
-
-    info_array->maps[info_array->length++] = new_map;
-
-    continue;
-
-    cleanup_maps_and_path:
-      free(path_str);
-    cleanup_maps:
-      for (size_t i = 0; i < info_array->length; i++) {
-        free(info_array->maps[i].path);
-      }
-      free(info_array->maps);
-      free(info_array);
-
+    if (!parse_maps_line(line, info_array, &infos_capacity)) {
+      free_maps(info_array);
       fclose(fp);
 
       return NULL;
+    }
   }
 
   fclose(fp);
 
-  /* INFO: Resize to the actual size */
-  struct map_entry *tmp_maps = realloc(info_array->maps, info_array->length * sizeof(struct map_entry));
-  if (!tmp_maps)
-    PLOGE("reallocate memory for maps");
-
-  if (tmp_maps) info_array->maps = tmp_maps;
+  maps_info_shrink(info_array);
 
   return info_array;
 }
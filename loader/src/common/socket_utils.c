@@ -253,3 +253,6 @@ read_func(uint32_t)
 
 write_func(size_t)
 read_func(size_t)
+
+write_func(uint64_t)
+read_func(uint64_t)
@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logging.h"
+
+#include "trace.h"
+
+struct rz_trace_buffer *rz_trace_buffer = NULL;
+static size_t rz_trace_buffer_size = 0;
+
+bool rz_trace_attach(int fd, bool writable) {
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    PLOGE("fstat trace buffer");
+
+    return false;
+  }
+
+  if ((size_t)st.st_size < sizeof(struct rz_trace_buffer)) {
+    LOGE("Trace buffer is too small: %lld", (long long)st.st_size);
+
+    return false;
+  }
+
+  int prot = PROT_READ | (writable ? PROT_WRITE : 0);
+  struct rz_trace_buffer *buffer = mmap(NULL, (size_t)st.st_size, prot, MAP_SHARED, fd, 0);
+  if (buffer == MAP_FAILED) {
+    PLOGE("mmap trace buffer");
+
+    return false;
+  }
+
+  if (buffer->magic != RZ_TRACE_MAGIC || buffer->version != RZ_TRACE_VERSION || buffer->capacity == 0 ||
+      sizeof(struct rz_trace_buffer) + buffer->capacity * sizeof(struct rz_trace_event) > (size_t)st.st_size) {
+    LOGE("Invalid trace buffer");
+
+    munmap(buffer, (size_t)st.st_size);
+
+    return false;
+  }
+
+  rz_trace_buffer = buffer;
+  rz_trace_buffer_size = (size_t)st.st_size;
+
+  return true;
+}
+
+void rz_trace_detach(void) {
+  if (!rz_trace_buffer) return;
+
+  munmap(rz_trace_buffer, rz_trace_buffer_size);
+  rz_trace_buffer = NULL;
+  rz_trace_buffer_size = 0;
+}
+
+void rz_trace_append(enum rz_trace_event_type type, uint16_t module, uint32_t arg) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  uint32_t index = __atomic_fetch_add(&rz_trace_buffer->head, 1, __ATOMIC_RELAXED);
+  struct rz_trace_event *event = &rz_trace_buffer->events[index % rz_trace_buffer->capacity];
+
+  __atomic_store_n(&event->seq, 0, __ATOMIC_RELAXED);
+
+  event->pid = getpid();
+  event->timestamp_ns = (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+  event->type = (uint16_t)type;
+  event->module = module;
+  event->arg = arg;
+
+  __atomic_store_n(&event->seq, index + 1, __ATOMIC_RELEASE);
+}
+
+static const char *rz_trace_event_name(uint16_t type) {
+  switch (type) {
+    case RZ_TRACE_FORK:                 return "fork";
+    case RZ_TRACE_FLAGS_QUERY_SENT:     return "flags query sent";
+    case RZ_TRACE_FLAGS_QUERY_RECEIVED: return "flags query received";
+    case RZ_TRACE_DAEMON_FLAGS_QUERY:   return "ReZygiskd: flags query";
+    case RZ_TRACE_DAEMON_FLAGS_REPLY:   return "ReZygiskd: flags reply";
+    case RZ_TRACE_SETNS:                return "setns";
+    case RZ_TRACE_MODULES_PRE_START:    return "modules pre callbacks";
+    case RZ_TRACE_MODULE_PRE_DONE:      return "module pre callback done";
+    case RZ_TRACE_MODULES_POST_START:   return "modules post callbacks";
+    case RZ_TRACE_MODULE_POST_DONE:     return "module post callback done";
+    case RZ_TRACE_MODULES_UNLOADED:     return "modules unloaded";
+    case RZ_TRACE_FDS_SANITIZED:        return "fds sanitized";
+    case RZ_TRACE_SELF_UNLOAD:          return "libzygisk unload";
+    case RZ_TRACE_MEM_SAMPLE:           return "memory sample";
+    case RZ_TRACE_MEM_PSS:              return "  PSS";
+    case RZ_TRACE_MEM_PRIVATE_DIRTY:    return "  private dirty";
+    default:                            return "unknown";
+  }
+}
+
+static const char *rz_trace_mem_point_name(uint32_t point) {
+  switch (point) {
+    case RZ_TRACE_MEM_BEFORE_SPECIALIZE:    return "before specialize";
+    case RZ_TRACE_MEM_AFTER_SPECIALIZE:     return "after specialize";
+    case RZ_TRACE_MEM_AFTER_MODULES_UNLOAD: return "after modules unload";
+    case RZ_TRACE_MEM_BEFORE_SELF_UNLOAD:   return "before libzygisk unload";
+    default:                                return "unknown";
+  }
+}
+
+static int rz_trace_event_compare(const void *a, const void *b) {
+  const struct rz_trace_event *event_a = (const struct rz_trace_event *)a;
+  const struct rz_trace_event *event_b = (const struct rz_trace_event *)b;
+
+  if (event_a->pid != event_b->pid) return event_a->pid < event_b->pid ? -1 : 1;
+  if (event_a->timestamp_ns != event_b->timestamp_ns) return event_a->timestamp_ns < event_b->timestamp_ns ? -1 : 1;
+  /* INFO: Memory samples are appended back to back, possibly within the same nanosecond */
+  if (event_a->seq != event_b->seq) return event_a->seq < event_b->seq ? -1 : 1;
+
+  return 0;
+}
+
+void rz_trace_dump(void) {
+  uint32_t capacity = rz_trace_buffer->capacity;
+  uint32_t head = __atomic_load_n(&rz_trace_buffer->head, __ATOMIC_ACQUIRE);
+  uint32_t available = head < capacity ? head : capacity;
+
+  struct rz_trace_event *events = (struct rz_trace_event *)malloc(available * sizeof(struct rz_trace_event));
+  if (!events && available != 0) {
+    PLOGE("allocating trace events memory");
+
+    return;
+  }
+
+  /* INFO: Only slots whose sequence matches their index, both before and after
+             copying them, are complete and not overwritten by a newer lap. */
+  size_t events_count = 0;
+  for (uint32_t index = head - available; index != head; index++) {
+    struct rz_trace_event *event = &rz_trace_buffer->events[index % capacity];
+    if (__atomic_load_n(&event->seq, __ATOMIC_ACQUIRE) != index + 1) continue;
+
+    events[events_count] = *event;
+    if (__atomic_load_n(&event->seq, __ATOMIC_ACQUIRE) != index + 1) continue;
+
+    events_count++;
+  }
+
+  if (head > capacity) printf("%u older events were overwritten\n\n", head - capacity);
+
+  qsort(events, events_count, sizeof(struct rz_trace_event), rz_trace_event_compare);
+
+  for (size_t i = 0; i < events_count; i++) {
+    struct rz_trace_event *event = &events[i];
+
+    bool first = i == 0 || events[i - 1].pid != event->pid;
+    if (first) printf("%sProcess %d:\n", i == 0 ? "" : "\n", event->pid);
+
+    uint64_t since_prev = first ? 0 : event->timestamp_ns - events[i - 1].timestamp_ns;
+
+    printf("  %" PRIu64 ".%06" PRIu64 "s (+%" PRIu64 ".%03" PRIu64 "ms) %s",
+           event->timestamp_ns / 1000000000, (event->timestamp_ns / 1000) % 1000000,
+           since_prev / 1000000, (since_prev / 1000) % 1000, rz_trace_event_name(event->type));
+
+    if (event->module != RZ_TRACE_NO_MODULE) printf(" [module %u]", event->module);
+
+    switch (event->type) {
+      case RZ_TRACE_DAEMON_FLAGS_QUERY: {
+        printf(" uid=%u", event->arg);
+
+        break;
+      }
+      case RZ_TRACE_FLAGS_QUERY_RECEIVED:
+      case RZ_TRACE_DAEMON_FLAGS_REPLY: {
+        printf(" flags=0x%08x", event->arg);
+
+        break;
+      }
+      case RZ_TRACE_SETNS: {
+        printf(" %s", event->arg == 0 ? "clean" : "mounted");
+
+        break;
+      }
+      case RZ_TRACE_MODULES_UNLOADED: {
+        printf(" count=%u", event->arg);
+
+        break;
+      }
+      case RZ_TRACE_FDS_SANITIZED: {
+        printf(" closes=%u", event->arg);
+
+        break;
+      }
+      case RZ_TRACE_MEM_SAMPLE: {
+        printf(" %s", rz_trace_mem_point_name(event->arg));
+
+        break;
+      }
+      case RZ_TRACE_MEM_PSS:
+      case RZ_TRACE_MEM_PRIVATE_DIRTY: {
+        printf(" %s%ukB", event->module == RZ_TRACE_NO_MODULE ? "[ReZygisk] " : "", event->arg);
+
+        break;
+      }
+    }
+
+    printf("\n");
+  }
+
+  free(events);
+}
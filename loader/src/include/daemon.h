@@ -2,6 +2,7 @@
 #define DAEMON_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <unistd.h>
 
@@ -14,11 +15,17 @@ enum rezygiskd_actions {
   GetModuleDir,
   ZygoteRestart,
   UpdateMountNamespace,
-  RemoveModule
+  RemoveModule,
+  GetStats,
+  GetTraceBuffer,
+  GetModuleStatsBuffer,
+  GetModuleRelro
 };
 
 struct zygisk_modules {
   char **modules;
+  /* INFO: Newline separated process globs of each module, NULL if it targets every process */
+  char **targets;
   size_t modules_count;
 };
 
@@ -36,6 +43,26 @@ struct rezygisk_info {
   bool running;
 };
 
+/* INFO: Same as ReZygiskd's STATS_BUCKETS, the histogram buckets are in log2 of microseconds */
+#define REZYGISKD_STATS_MAX_BUCKETS 32
+
+struct rezygiskd_stat {
+  char *name;
+  uint64_t count;
+  uint64_t total_us;
+  uint64_t max_us;
+  uint32_t buckets[REZYGISKD_STATS_MAX_BUCKETS];
+};
+
+struct rezygiskd_stats {
+  struct rezygiskd_stat *entries;
+  size_t entries_count;
+  /* INFO: Callback timings, named "<module>: <onLoad|pre|post>" */
+  struct rezygiskd_stat *module_entries;
+  size_t module_entries_count;
+  uint32_t buckets_count;
+};
+
 enum mount_namespace_state {
   Clean,
   Mounted
@@ -51,6 +78,13 @@ int rezygiskd_connect(uint8_t retry);
 
 bool rezygiskd_zygote_injected();
 
+/* INFO: Sends the request and returns the connection to read the flags from later,
+           or -1. The reply can be read from a process forked in between. */
+int rezygiskd_request_process_flags(uid_t uid, const char *const process);
+
+/* INFO: Reads the reply of rezygiskd_request_process_flags, closing "fd" */
+uint32_t rezygiskd_read_process_flags(int fd);
+
 uint32_t rezygiskd_get_process_flags(uid_t uid, const char *const process);
 
 void rezygiskd_get_info(struct rezygisk_info *info);
@@ -69,6 +103,21 @@ void rezygiskd_zygote_restart();
 
 bool rezygiskd_update_mns(enum mount_namespace_state nms_state, char *buf, size_t buf_size);
 
-bool rezygiskd_remove_module(size_t index);
+/* INFO: "indices" are in increasing order, and refer to the list before any removal */
+bool rezygiskd_remove_modules(const size_t *indices, size_t indices_count);
+
+bool rezygiskd_get_stats(struct rezygiskd_stats *stats);
+
+void free_rezygiskd_stats(struct rezygiskd_stats *stats);
+
+/* INFO: Returns -1 if tracing is disabled in ReZygiskd */
+int rezygiskd_get_trace_buffer(void);
+
+/* INFO: Returns -1 if ReZygiskd has no module stats buffer */
+int rezygiskd_get_module_stats_buffer(void);
+
+/* INFO: Memfd of the shared RELRO of the module, with "role" telling whether to
+           publish to it or to use it. Returns -1 if none is available. */
+int rezygiskd_get_module_relro(size_t index, uint8_t *role);
 
 #endif /* DAEMON_H */
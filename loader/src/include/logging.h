@@ -2,7 +2,10 @@
 #define LOGGING_H
 
 #include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
+#include <time.h>
 
 #include <android/log.h>
 
@@ -20,9 +23,59 @@
   #define LOGV(...)
 #endif
 
-#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
-#define LOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
-#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+/* INFO: Each call site may log this many messages per second, the rest are counted
+           and reported once the call site logs again in a later second. Unlike in
+           ReZygiskd, writes stay synchronous: Zygote must be single-threaded when
+           it forks, so there can be no background writer. */
+#define LOG_RATELIMIT_BURST 20
+
+struct log_ratelimit {
+  uint32_t window;
+  uint32_t count;
+  uint32_t suppressed;
+};
+
+static inline bool log_ratelimit_allow(struct log_ratelimit *ratelimit, uint32_t *suppressed) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+
+  /* INFO: 0 is the initial value, so the first window must never be 0 */
+  uint32_t now = (uint32_t)ts.tv_sec + 1;
+  if (ratelimit->window != now) {
+    ratelimit->window = now;
+    ratelimit->count = 0;
+    *suppressed = ratelimit->suppressed;
+    ratelimit->suppressed = 0;
+  }
+
+  if (ratelimit->count++ < LOG_RATELIMIT_BURST) return true;
+
+  ratelimit->suppressed++;
+
+  return false;
+}
+
+/* INFO: errno is saved first and restored right before the message, so that the
+           arguments, like the ones of PLOGE, are evaluated with the caller's errno,
+           not with what the rate limiting or the suppressed notice left in it. */
+#define LOG_RATELIMITED(prio, ...)                                                          \
+  do {                                                                                      \
+    static struct log_ratelimit log_ratelimit;                                              \
+    int log_errno = errno;                                                                  \
+    uint32_t log_suppressed = 0;                                                            \
+    if (log_ratelimit_allow(&log_ratelimit, &log_suppressed)) {                             \
+      if (log_suppressed != 0)                                                              \
+        __android_log_print(ANDROID_LOG_WARN, LOG_TAG, "Suppressed %u messages from %s:%d", \
+                            log_suppressed, __FILE__, __LINE__);                            \
+      errno = log_errno;                                                                    \
+      __android_log_print(prio, LOG_TAG, __VA_ARGS__);                                      \
+    }                                                                                       \
+    errno = log_errno;                                                                      \
+  } while (0)
+
+#define LOGI(...) LOG_RATELIMITED(ANDROID_LOG_INFO, __VA_ARGS__)
+#define LOGW(...) LOG_RATELIMITED(ANDROID_LOG_WARN, __VA_ARGS__)
+#define LOGE(...) LOG_RATELIMITED(ANDROID_LOG_ERROR, __VA_ARGS__)
 #define LOGF(...) __android_log_print(ANDROID_LOG_FATAL, LOG_TAG, __VA_ARGS__)
 #define PLOGE(fmt, args...) LOGE(fmt " failed with %d: %s", ##args, errno, strerror(errno))
 
@@ -39,7 +39,18 @@ int parse_int(const char *str);
 
 struct kernel_version parse_kversion();
 
-struct maps_info *parse_maps_safe(const char *pid);
+/* INFO: Maps of the calling process. With PROCMAP_QUERY, they are read through an
+           fd kept open until parse_maps_self_close(), which must be called before
+           any fd check. */
+struct maps_info *parse_maps_self(void);
+
+void parse_maps_self_close(void);
+
+/* INFO: Reads a /proc/self file, such as "/proc/self/smaps", through a helper task
+           so that its access time is left alone. The buffer starts at "capacity",
+           which is updated to the one the text fit in. Returns the text, NUL
+           terminated and to be freed, or NULL. */
+char *read_self_proc_file(const char *path, size_t *capacity, size_t *len);
 
 struct maps_info *parse_maps(const char *pid);
 
@@ -34,4 +34,7 @@ read_func_def(uint32_t);
 write_func_def(size_t);
 read_func_def(size_t);
 
+write_func_def(uint64_t);
+read_func_def(uint64_t);
+
 #endif /* SOCKET_UTILS_H */
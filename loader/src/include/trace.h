@@ -0,0 +1,81 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* INFO: Must be kept in sync with zygiskd/src/trace.h */
+
+#define RZ_TRACE_MAGIC 0x5254525a /* INFO: "ZRTR" */
+#define RZ_TRACE_VERSION 2
+
+#define RZ_TRACE_NO_MODULE 0xffff
+
+enum rz_trace_event_type {
+  RZ_TRACE_FORK = 1,
+  RZ_TRACE_FLAGS_QUERY_SENT,
+  RZ_TRACE_FLAGS_QUERY_RECEIVED,
+  RZ_TRACE_DAEMON_FLAGS_QUERY,
+  RZ_TRACE_DAEMON_FLAGS_REPLY,
+  RZ_TRACE_SETNS,
+  RZ_TRACE_MODULES_PRE_START,
+  RZ_TRACE_MODULE_PRE_DONE,
+  RZ_TRACE_MODULES_POST_START,
+  RZ_TRACE_MODULE_POST_DONE,
+  RZ_TRACE_MODULES_UNLOADED,
+  RZ_TRACE_FDS_SANITIZED,
+  RZ_TRACE_SELF_UNLOAD,
+  /* INFO: Followed by the PSS and private dirty events of ReZygisk and each module */
+  RZ_TRACE_MEM_SAMPLE,
+  RZ_TRACE_MEM_PSS,
+  RZ_TRACE_MEM_PRIVATE_DIRTY
+};
+
+#define RZ_TRACE_FLAG_MEMORY 0x1
+
+enum rz_trace_mem_point {
+  RZ_TRACE_MEM_BEFORE_SPECIALIZE,
+  RZ_TRACE_MEM_AFTER_SPECIALIZE,
+  RZ_TRACE_MEM_AFTER_MODULES_UNLOAD,
+  RZ_TRACE_MEM_BEFORE_SELF_UNLOAD
+};
+
+struct rz_trace_event {
+  /* INFO: Slot index + 1, stored last, so that readers can skip slots still being written */
+  uint32_t seq;
+  int32_t pid;
+  uint64_t timestamp_ns;
+  uint16_t type;
+  uint16_t module;
+  uint32_t arg;
+};
+
+struct rz_trace_buffer {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t capacity;
+  uint32_t flags;
+  uint32_t head;
+  uint32_t reserved;
+  struct rz_trace_event events[];
+};
+
+extern struct rz_trace_buffer *rz_trace_buffer;
+
+/* INFO: When tracing is disabled, which is the default, this is a single branch */
+#define RZ_TRACE(type, module, arg)                                          \
+  do {                                                                       \
+    if (rz_trace_buffer) rz_trace_append((type), (module), (uint32_t)(arg)); \
+  } while (0)
+
+#define RZ_TRACE_MEMORY_ENABLED() (rz_trace_buffer && (rz_trace_buffer->flags & RZ_TRACE_FLAG_MEMORY))
+
+bool rz_trace_attach(int fd, bool writable);
+
+void rz_trace_detach(void);
+
+void rz_trace_append(enum rz_trace_event_type type, uint16_t module, uint32_t arg);
+
+void rz_trace_dump(void);
+
+#endif /* TRACE_H */
@@ -14,6 +14,14 @@ static size_t art_method_size = 0;
 static size_t entry_point_offset = 0;
 static size_t data_offset = 0;
 
+/* INFO: access_flags_ follows the 4 bytes GcRoot<mirror::Class> declaring_class_ */
+#define ART_METHOD_ACCESS_FLAGS_OFFSET 4
+#define ART_ACC_PUBLIC 0x0001
+#define ART_ACC_STATIC 0x0008
+#define ART_ACC_NATIVE 0x0100
+
+static bool access_flags_usable = false;
+
 static inline void *amethod_from_reflected_method(JNIEnv *env, jobject method);
 
 /*
@@ -100,6 +108,67 @@ static inline bool amethod_init(JNIEnv *env) {
   return true;
 }
 
+static inline uint32_t amethod_get_access_flags(uintptr_t self) {
+  return __atomic_load_n((uint32_t *)(self + ART_METHOD_ACCESS_FLAGS_OFFSET), __ATOMIC_RELAXED);
+}
+
+/* INFO: Checks whether the access flags read straight from ArtMethod agree with
+           reflection for a known native and a known non-native method. If they
+           do, amethod_is_native can skip reflection. */
+static inline bool amethod_check_access_flags(JNIEnv *env, jclass clazz, const char *name, const char *signature, bool is_static, jmethodID get_modifiers, jint modifier_native, bool *is_native) {
+  jmethodID mid = is_static ? (*env)->GetStaticMethodID(env, clazz, name, signature) : (*env)->GetMethodID(env, clazz, name, signature);
+  if (!mid) {
+    (*env)->ExceptionClear(env);
+
+    return false;
+  }
+
+  jobject method = (*env)->ToReflectedMethod(env, clazz, mid, is_static);
+  if (!method) {
+    (*env)->ExceptionClear(env);
+
+    return false;
+  }
+
+  jint modifiers = (*env)->CallIntMethod(env, method, get_modifiers);
+  uintptr_t art_method = (uintptr_t)amethod_from_reflected_method(env, method);
+  (*env)->DeleteLocalRef(env, method);
+
+  if ((*env)->ExceptionCheck(env) || !art_method) {
+    (*env)->ExceptionClear(env);
+
+    return false;
+  }
+
+  uint32_t flags = amethod_get_access_flags(art_method);
+  *is_native = (modifiers & modifier_native) != 0;
+
+  return ((flags & ART_ACC_NATIVE) != 0) == ((modifiers & modifier_native) != 0) &&
+         ((flags & ART_ACC_STATIC) != 0) == is_static &&
+         ((flags & ART_ACC_PUBLIC) != 0) == ((modifiers & ART_ACC_PUBLIC) != 0);
+}
+
+static inline void amethod_init_access_flags(JNIEnv *env, jmethodID get_modifiers, jint modifier_native) {
+  access_flags_usable = false;
+
+  jclass thread = (*env)->FindClass(env, "java/lang/Thread");
+  jclass object = (*env)->FindClass(env, "java/lang/Object");
+  if (thread && object) {
+    /* INFO: Both must agree, and differ from each other, so that a wrong offset can't pass by chance */
+    bool thread_native = false, object_native = false;
+    access_flags_usable = amethod_check_access_flags(env, thread, "currentThread", "()Ljava/lang/Thread;", true, get_modifiers, modifier_native, &thread_native) &&
+                          amethod_check_access_flags(env, object, "toString", "()Ljava/lang/String;", false, get_modifiers, modifier_native, &object_native) &&
+                          thread_native && !object_native;
+  } else {
+    (*env)->ExceptionClear(env);
+  }
+
+  if (thread) (*env)->DeleteLocalRef(env, thread);
+  if (object) (*env)->DeleteLocalRef(env, object);
+
+  LOGD("ArtMethod access flags %s", access_flags_usable ? "usable" : "unusable, using reflection");
+}
+
 static inline void *amethod_get_data(uintptr_t self) {
   return *(void **)(self + data_offset);
 }
@@ -291,7 +291,15 @@ static void do_hook_zygote(JNIEnv *env) {
   int hooks_count = 0;
 
   const char *clz = "com/android/internal/os/Zygote";
-  hook_jni_methods(env, clz, nativeForkAndSpecialize_methods, nativeForkAndSpecialize_methods_count);
+
+  /* INFO: All variants are registered with a single RegisterNatives */
+  struct jni_hook_batch batch;
+  jni_hook_batch_init(env, &batch, clz);
+  jni_hook_batch_add(env, &batch, nativeForkAndSpecialize_methods, nativeForkAndSpecialize_methods_count);
+  jni_hook_batch_add(env, &batch, nativeSpecializeAppProcess_methods, nativeSpecializeAppProcess_methods_count);
+  jni_hook_batch_add(env, &batch, nativeForkSystemServer_methods, nativeForkSystemServer_methods_count);
+  jni_hook_batch_commit(env, &batch);
+
   for (int i = 0; i < nativeForkAndSpecialize_methods_count; i++) {
     if (!nativeForkAndSpecialize_methods[i].fnPtr) continue;
 
@@ -301,7 +309,6 @@ static void do_hook_zygote(JNIEnv *env) {
     break;
   }
 
-  hook_jni_methods(env, clz, nativeSpecializeAppProcess_methods, nativeSpecializeAppProcess_methods_count);
   for (int i = 0; i < nativeSpecializeAppProcess_methods_count; i++) {
     if (!nativeSpecializeAppProcess_methods[i].fnPtr) continue;
 
@@ -311,7 +318,6 @@ static void do_hook_zygote(JNIEnv *env) {
     break;
   }
 
-  hook_jni_methods(env, clz, nativeForkSystemServer_methods, nativeForkSystemServer_methods_count);
   for (int i = 0; i < nativeForkSystemServer_methods_count; i++) {
     if (!nativeForkSystemServer_methods[i].fnPtr) continue;
 
@@ -321,7 +327,7 @@ static void do_hook_zygote(JNIEnv *env) {
     break;
   }
 
-  jni_hook_list_add(clz, hooks, hooks_count);
+  jni_hook_list_add(env, clz, hooks, hooks_count);
 }
 
 #endif /* JNI_HOOKS_H */
@@ -4,15 +4,19 @@
 #include <string.h>
 
 #include <dlfcn.h>
+#include <fnmatch.h>
 #include <regex.h>
 
 #include <dirent.h>
 #include <fcntl.h>
 #include <limits.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/sysmacros.h>
+#include <time.h>
 
 #include <unistd.h>
 
@@ -22,9 +26,15 @@
 #include "daemon.h"
 #include "misc.h"
 #include "module.h"
+#include "trace.h"
 
 #include "art_method.h"
 #include "cpp_strings.h"
+#include "maps_snapshot.h"
+#include "mem_stats.h"
+#include "module_stats.h"
+#include "plt_matcher.h"
+#include "shared_relro.h"
 
 void *start_addr = NULL;
 size_t block_size = 0;
@@ -41,20 +51,31 @@ enum {
   FLAG_MAX
 };
 
-#define MAX_FD_SIZE 1024
 #define MAX_REGISTER_INFO 64
 #define MAX_IGNORE_INFO 64
-#define MAX_EXEMPTED_FDS 128
+
+/* INFO: One bit per fd, first sized to RLIMIT_NOFILE, and grown when an fd is found
+           past it, as the limit may have been lowered after the fd was opened. */
+struct fd_bitmap {
+  unsigned long *words;
+  size_t words_count;
+};
+
+#define FD_BITMAP_WORD_BITS (sizeof(unsigned long) * 8)
+
+/* INFO: Bound for when RLIMIT_NOFILE is unlimited, and for growing. The kernel's
+           default fs.nr_open, so no fd is above it unless that was raised. */
+#define FD_BITMAP_MAX_FDS (1 << 20)
 
 struct register_info {
-  regex_t regex;
+  struct plt_matcher_pattern matcher;
   char *symbol;
   void *callback;
   void **backup;
 };
 
 struct ignore_info {
-  regex_t regex;
+  struct plt_matcher_pattern matcher;
   char *symbol;
 };
 
@@ -71,8 +92,9 @@ struct zygisk_context {
   int pid;
   uint32_t flags;
   uint32_t info_flags;
-  uint8_t allowed_fds[MAX_FD_SIZE];
-  int exempted_fds[MAX_EXEMPTED_FDS];
+  int info_flags_fd;
+  struct fd_bitmap allowed_fds;
+  int *exempted_fds;
   size_t exempted_fds_count;
 
   pthread_mutex_t hook_info_lock;
@@ -110,8 +132,14 @@ static inline bool is_zygote_child(struct zygisk_context *ctx) {
   return ctx->pid <= 0;
 }
 
+/* INFO: Registered with (dev, inode) and resolved to a library path at commit,
+           so that maps are only looked up once per library. */
 struct plt_hook_entry {
+  dev_t dev;
+  ino_t inode;
   const char *lib_path;
+  bool owns_lib_path;
+  bool resolved;
   const char *symbol;
   void *new_func;
   void **backup;
@@ -119,6 +147,8 @@ struct plt_hook_entry {
 
 struct jni_hook_entry {
   char *class_name;
+  /* INFO: Global reference taken in Zygote, so that children restore without FindClass */
+  jclass clazz;
   JNINativeMethod *methods;
   size_t methods_count;
 };
@@ -138,7 +168,7 @@ static bool should_unmap_zygisk = false;
 static bool enable_unloader = false;
 
 /* INFO: Helper function to add to PLT hook list */
-static bool plt_hook_list_add(const char *lib_path, const char *symbol, void *new_func, void **backup) {
+static bool plt_hook_list_add(dev_t dev, ino_t inode, const char *symbol, void *new_func, void **backup) {
   struct plt_hook_entry *new_plt_hook_list = realloc(plt_hook_list, (plt_hook_list_count + 1) * sizeof(struct plt_hook_entry));
   if (!new_plt_hook_list) {
     LOGE("Failed to reallocate buffer for PLT hook list");
@@ -147,7 +177,11 @@ static bool plt_hook_list_add(const char *lib_path, const char *symbol, void *ne
   }
   plt_hook_list = new_plt_hook_list;
 
-  plt_hook_list[plt_hook_list_count].lib_path = lib_path;
+  plt_hook_list[plt_hook_list_count].dev = dev;
+  plt_hook_list[plt_hook_list_count].inode = inode;
+  plt_hook_list[plt_hook_list_count].lib_path = NULL;
+  plt_hook_list[plt_hook_list_count].owns_lib_path = false;
+  plt_hook_list[plt_hook_list_count].resolved = false;
   plt_hook_list[plt_hook_list_count].symbol = symbol;
   plt_hook_list[plt_hook_list_count].new_func = new_func;
   plt_hook_list[plt_hook_list_count].backup = backup;
@@ -156,8 +190,42 @@ static bool plt_hook_list_add(const char *lib_path, const char *symbol, void *ne
   return true;
 }
 
+static bool hook_register(const char *lib_name, const char *symbol, bool is_prefix, void *new_func, void **backup) {
+  if (!(is_prefix ? plti_add_hook_by_prefix : plti_add_hook)(&plti_ctx, lib_name, symbol, new_func, backup)) {
+    LOGE("Failed to register plt_hook \"%s\" with PLTI", symbol);
+
+    return false;
+  }
+
+  LOGD("Registered plt_hook for symbol \"%s\" in library \"%s\"", symbol, lib_name);
+
+  return true;
+}
+
+static uint64_t now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static void plt_hook_list_clear(void) {
+  if (!plt_hook_list) return;
+
+  for (size_t i = 0; i < plt_hook_list_count; i++) {
+    if (plt_hook_list[i].owns_lib_path) free((void *)plt_hook_list[i].lib_path);
+    free((void *)plt_hook_list[i].symbol);
+  }
+
+  free(plt_hook_list);
+  plt_hook_list = NULL;
+  plt_hook_list_count = 0;
+}
+
+static jclass jni_class_cache_find(JNIEnv *env, const char *class_name);
+
 /* INFO: Helper function to add to JNI hook list */
-static void jni_hook_list_add(const char *class_name, JNINativeMethod *methods, size_t count) {
+static void jni_hook_list_add(JNIEnv *env, const char *class_name, JNINativeMethod *methods, size_t count) {
   struct jni_hook_entry *new_jni_hook_list = realloc(jni_hook_list, (jni_hook_list_count + 1) * sizeof(struct jni_hook_entry));
   if (!new_jni_hook_list) {
     LOGE("Failed to reallocate buffer for JNI hook list");
@@ -184,10 +252,143 @@ static void jni_hook_list_add(const char *class_name, JNINativeMethod *methods,
 
   memcpy(jni_hook_list[jni_hook_list_count].methods, methods, count * sizeof(JNINativeMethod));
 
+  /* INFO: The class cache already holds it, so this costs no FindClass */
+  jclass clazz = jni_class_cache_find(env, class_name);
+  jni_hook_list[jni_hook_list_count].clazz = clazz ? (jclass)(*env)->NewGlobalRef(env, clazz) : NULL;
+
   jni_hook_list[jni_hook_list_count].methods_count = count;
   jni_hook_list_count++;
 }
 
+/* INFO: Whether the paths of Zygote's fds exist, per mount namespace. The same few
+           dozen paths are checked in every child, so the results are kept in a
+           shared anonymous mapping created by Zygote: the first child to check a
+           path in a namespace fills its slot, and later children only read it.
+           Namespaces are identified by inode, so a namespace rebuilt by ReZygiskd
+           never matches older entries, whose slots are free to be claimed again.
+           Only existing paths are kept, as nothing could tell when a missing one
+           appears. Children unmap it at cleanup, before any app code runs, so that
+           only pre-specialize children can write to it. */
+#define FD_PATH_CACHE_SLOTS 128
+#define FD_PATH_CACHE_PROBES 8
+#define FD_PATH_CACHE_PATH_MAX 232
+
+enum fd_path_cache_slot_state {
+  FD_PATH_CACHE_SLOT_EMPTY,
+  FD_PATH_CACHE_SLOT_WRITING,
+  FD_PATH_CACHE_SLOT_READY
+};
+
+struct fd_path_cache_slot {
+  uint32_t state;
+  uint64_t mnt_ns;
+  uint64_t dev;
+  uint64_t ino;
+  char path[FD_PATH_CACHE_PATH_MAX];
+};
+
+static struct fd_path_cache_slot *fd_path_cache = NULL;
+static uint64_t current_mnt_ns = 0;
+
+static void fd_path_cache_init(void) {
+  struct stat st;
+  if (stat("/proc/self/ns/mnt", &st) == -1) {
+    PLOGE("stat Zygote mount namespace");
+
+    return;
+  }
+
+  void *cache = mmap(NULL, FD_PATH_CACHE_SLOTS * sizeof(struct fd_path_cache_slot), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (cache == MAP_FAILED) {
+    PLOGE("allocate fd path cache");
+
+    return;
+  }
+
+  fd_path_cache = (struct fd_path_cache_slot *)cache;
+  current_mnt_ns = (uint64_t)st.st_ino;
+}
+
+static void fd_path_cache_unmap(void) {
+  if (!fd_path_cache) return;
+
+  munmap(fd_path_cache, FD_PATH_CACHE_SLOTS * sizeof(struct fd_path_cache_slot));
+  fd_path_cache = NULL;
+}
+
+static size_t fd_path_cache_hash(const char *path) {
+  uint64_t hash = 0xcbf29ce484222325ULL ^ current_mnt_ns;
+  for (const char *c = path; *c; c++) {
+    hash ^= (uint8_t)*c;
+    hash *= 0x100000001b3ULL;
+  }
+
+  return (size_t)hash;
+}
+
+/* INFO: Whether "path" exists in the current mount namespace. A cached entry is
+           only trusted for the very file the fd was opened from. */
+static bool fd_path_exists(const char *path, const struct stat *fd_stat) {
+  size_t path_len = strlen(path);
+  if (!fd_path_cache || path_len >= FD_PATH_CACHE_PATH_MAX) return access(path, F_OK) == 0;
+
+  size_t start = fd_path_cache_hash(path);
+  struct fd_path_cache_slot *free_slot = NULL;
+  uint32_t free_slot_state = FD_PATH_CACHE_SLOT_EMPTY;
+  for (size_t i = 0; i < FD_PATH_CACHE_PROBES; i++) {
+    struct fd_path_cache_slot *slot = &fd_path_cache[(start + i) % FD_PATH_CACHE_SLOTS];
+
+    uint32_t state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+    if (state == FD_PATH_CACHE_SLOT_EMPTY) {
+      if (!free_slot) {
+        free_slot = slot;
+        free_slot_state = state;
+      }
+
+      break;
+    }
+
+    if (state != FD_PATH_CACHE_SLOT_READY) continue;
+
+    /* INFO: Left by an older namespace, which no child will use again */
+    if (slot->mnt_ns != current_mnt_ns) {
+      if (!free_slot) {
+        free_slot = slot;
+        free_slot_state = state;
+      }
+
+      continue;
+    }
+
+    if (strcmp(slot->path, path) != 0) continue;
+
+    bool same_file = slot->dev == (uint64_t)fd_stat->st_dev && slot->ino == (uint64_t)fd_stat->st_ino;
+
+    /* INFO: Only if no other child reclaimed the slot while it was being read */
+    if (same_file && __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE) == FD_PATH_CACHE_SLOT_READY && slot->mnt_ns == current_mnt_ns) return true;
+
+    /* INFO: The path now leads to another file, so check it, but keep the slot */
+    free_slot = NULL;
+
+    break;
+  }
+
+  struct stat st;
+  if (stat(path, &st) == -1) return false;
+
+  /* INFO: Claim the slot, unless another child did so in the meantime */
+  if (free_slot && __atomic_compare_exchange_n(&free_slot->state, &free_slot_state, FD_PATH_CACHE_SLOT_WRITING, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    free_slot->mnt_ns = current_mnt_ns;
+    free_slot->dev = (uint64_t)st.st_dev;
+    free_slot->ino = (uint64_t)st.st_ino;
+    memcpy(free_slot->path, path, path_len + 1);
+
+    __atomic_store_n(&free_slot->state, FD_PATH_CACHE_SLOT_READY, __ATOMIC_RELEASE);
+  }
+
+  return true;
+}
+
 static bool update_mnt_ns(enum mount_namespace_state mns_state, bool dry_run) {
   char ns_path[PATH_MAX];
   if (!rezygiskd_update_mns(mns_state, ns_path, sizeof(ns_path))) {
@@ -219,8 +420,15 @@ static bool update_mnt_ns(enum mount_namespace_state mns_state, bool dry_run) {
     return false;
   }
 
+  /* INFO: Identifies the namespace for the fd path cache */
+  struct stat ns_stat;
+  if (fstat(updated_ns, &ns_stat) == 0) current_mnt_ns = (uint64_t)ns_stat.st_ino;
+  else fd_path_cache_unmap();
+
   close(updated_ns);
 
+  RZ_TRACE(RZ_TRACE_SETNS, RZ_TRACE_NO_MODULE, mns_state);
+
   return true;
 }
 
@@ -229,6 +437,54 @@ static bool update_mnt_ns(enum mount_namespace_state mns_state, bool dry_run) {
   ret (*old_##func)(__VA_ARGS__);     \
   ret new_##func(__VA_ARGS__)
 
+/* INFO: Bootstrap hooks only exist to catch a single moment. Once it is caught,
+           they are retired, restoring the original GOT slot, so that the process
+           no longer pays for a trampoline on every call. */
+struct oneshot_hook {
+  const char *lib_name;
+  const char *symbol;
+  void *new_func;
+  void **backup;
+  bool armed;
+#ifndef NDEBUG
+  size_t hits;
+#endif
+};
+
+#define DCL_ONESHOT_HOOK_FUNC(lib, ret, func, ...)                                                     \
+  ret (*old_##func)(__VA_ARGS__);                                                                      \
+  ret new_##func(__VA_ARGS__);                                                                         \
+  static struct oneshot_hook func##_oneshot = { lib, #func, (void *)new_##func, (void **)&old_##func, false }; \
+  ret new_##func(__VA_ARGS__)
+
+#ifndef NDEBUG
+  #define ONESHOT_HOOK_HIT(func) func##_oneshot.hits++
+#else
+  #define ONESHOT_HOOK_HIT(func) ((void)0)
+#endif
+
+static bool hook_unregister(const char *lib_name, const char *symbol, bool is_prefix, void **backup);
+
+static bool oneshot_hook_arm(struct oneshot_hook *hook) {
+  if (hook->armed) return true;
+
+  hook->armed = hook_register(hook->lib_name, hook->symbol, false, hook->new_func, hook->backup);
+
+  return hook->armed;
+}
+
+static void oneshot_hook_retire(struct oneshot_hook *hook) {
+  if (!hook->armed) return;
+
+  hook->armed = false;
+
+#ifndef NDEBUG
+  LOGD("Retiring one-shot hook \"%s\" after %zu hit(s)", hook->symbol, hook->hits);
+#endif
+
+  hook_unregister(hook->lib_name, hook->symbol, false, hook->backup);
+}
+
 /* INFO: ReZygisk already performs a fork in zygisk_context::fork_pre, because of that,
            we avoid duplicate fork in nativeForkAndSpecialize and nativeForkSystemServer
            by caching the pid in fork_pre function and only performing fork if the pid
@@ -270,6 +526,7 @@ DCL_HOOK_FUNC(void, _ZNK18FileDescriptorInfo14ReopenOrDetach, void *_this, void
   const void *file_path_std_string = (const void *)((uintptr_t)_this + offsetof(struct FileDescriptorInfo, file_path_storage));
   const char *file_path = read_std_string(file_path_std_string);
   const bool is_sock = *(const bool *)((uintptr_t)_this + offsetof(struct FileDescriptorInfo, is_sock));
+  const struct stat *fd_stat = (const struct stat *)((uintptr_t)_this + offsetof(struct FileDescriptorInfo, stat));
 
   if (is_sock)
     goto bypass_fd_check;
@@ -277,7 +534,7 @@ DCL_HOOK_FUNC(void, _ZNK18FileDescriptorInfo14ReopenOrDetach, void *_this, void
   if (strncmp(file_path, "/memfd:/boot-image-methods.art", strlen("/memfd:/boot-image-methods.art")) == 0)
     goto bypass_fd_check;
 
-  if (access(file_path, F_OK) == -1) {
+  if (!fd_path_exists(file_path, fd_stat)) {
     LOGD("Failed to open file %s, detaching it", file_path);
 
     close(fd);
@@ -290,6 +547,7 @@ DCL_HOOK_FUNC(void, _ZNK18FileDescriptorInfo14ReopenOrDetach, void *_this, void
 }
 
 static void unhook_functions(void);
+static void rz_sample_memory(enum rz_trace_mem_point point);
 /* INFO: Self-unloading is not a direct task, it requires the utilization of tail
            optimization, which requires the signature to be the same as munmap, or
            else munmap will be executed and will try to reach our code, leading to
@@ -299,7 +557,9 @@ static void unhook_functions(void);
            when the VM daemon starts, to allow this to happen before the app can
            execute code.
 */
-DCL_HOOK_FUNC(int, pthread_attr_setstacksize, void *target, size_t size) {
+DCL_ONESHOT_HOOK_FUNC("libart.so", int, pthread_attr_setstacksize, void *target, size_t size) {
+  ONESHOT_HOOK_HIT(pthread_attr_setstacksize);
+
   int res = old_pthread_attr_setstacksize((pthread_attr_t *)target, size);
   LOGV("Call pthread_attr_setstacksize in [tid, pid]: %d, %d", gettid(), getpid());
 
@@ -309,6 +569,18 @@ DCL_HOOK_FUNC(int, pthread_attr_setstacksize, void *target, size_t size) {
   if (gettid() != getpid()) return res;
 
   if (should_unmap_zygisk) {
+    rz_sample_memory(RZ_TRACE_MEM_BEFORE_SELF_UNLOAD);
+
+    /* INFO: The sample reopened what rz_cleanup had closed, so that the app does
+               not inherit the maps fd and snapshot */
+    maps_snapshot_invalidate();
+    parse_maps_self_close();
+
+    RZ_TRACE(RZ_TRACE_SELF_UNLOAD, RZ_TRACE_NO_MODULE, 0);
+
+    /* INFO: Nothing is traced past this point, and the mapping must not outlive us */
+    rz_trace_detach();
+
     unhook_functions();
 
     csoloader_deinit();
@@ -338,18 +610,28 @@ DCL_HOOK_FUNC(int, pthread_attr_setstacksize, void *target, size_t size) {
     [[clang::musttail]] return munmap(start_addr, block_size);
   }
 
+  /* INFO: libzygisk.so stays, but the app must not keep the trace buffer mapped */
+  rz_trace_detach();
+
   return res;
 }
 
 static void initialize_jni_hook(void);
-DCL_HOOK_FUNC(char *, strdup, const char *str) {
+DCL_ONESHOT_HOOK_FUNC("libandroid_runtime.so", char *, strdup, const char *str) {
+  ONESHOT_HOOK_HIT(strdup);
+
+  /* INFO: Retiring may reset the backup, so keep the original around */
+  char *(*orig_strdup)(const char *) = old_strdup;
+
   if (strcmp(str, "com.android.internal.os.ZygoteInit") == 0) {
     LOGV("strdup %s", str);
 
+    oneshot_hook_retire(&strdup_oneshot);
+
     initialize_jni_hook();
   }
 
-  return old_strdup(str);
+  return orig_strdup(str);
 }
 
 static void hook_unloader(void);
@@ -366,10 +648,14 @@ static void hook_unloader(void);
    - https://github.com/aosp-mirror/platform_frameworks_base/blob/1cdfff555f4a21f71ccc978290e2e212e2f8b168/core/jni/AndroidRuntime.cpp#L1266
    - https://github.com/aosp-mirror/platform_frameworks_base/blob/1cdfff555f4a21f71ccc978290e2e212e2f8b168/core/jni/AndroidRuntime.cpp#L791
 */
-DCL_HOOK_FUNC(int, property_get, const char *key, char *value, const char *default_value) {
+DCL_ONESHOT_HOOK_FUNC("libandroid_runtime.so", int, property_get, const char *key, char *value, const char *default_value) {
+  ONESHOT_HOOK_HIT(property_get);
+
+  int (*orig_property_get)(const char *, char *, const char *) = old_property_get;
+
   hook_unloader();
 
-  return old_property_get(key, value, default_value);
+  return orig_property_get(key, value, default_value);
 }
 
 #undef DCL_HOOK_FUNC
@@ -378,70 +664,317 @@ static bool can_hook_jni = false;
 static jint MODIFIER_NATIVE = 0;
 static jmethodID member_getModifiers = NULL;
 
-void hook_jni_methods(JNIEnv *env, const char *clz, JNINativeMethod *methods, int numMethods) {
-  if (!can_hook_jni) return;
+/* INFO: Per-process cache of JNI hook resolution. Classes are kept as global
+           references, and methods map (class, name, signature) to their ArtMethod
+           and whether they are native. The current native entry is never cached,
+           as it changes whenever someone hooks the method. */
+struct jni_class_cache_entry {
+  char *name;
+  jclass clazz;
+};
 
-  jclass clazz = (*env)->FindClass(env, clz);
-  if (!clazz) {
+struct jni_method_cache_entry {
+  size_t class_index;
+  char *name;
+  char *signature;
+  void *art_method;
+  bool is_native;
+};
+
+static struct jni_class_cache_entry *jni_class_cache = NULL;
+static size_t jni_class_cache_count = 0;
+
+/* INFO: Open addressing, grown to keep at most half of the slots used */
+static struct jni_method_cache_entry *jni_method_cache = NULL;
+static size_t jni_method_cache_size = 0;
+static size_t jni_method_cache_count = 0;
+
+#define JNI_CACHE_FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define JNI_CACHE_FNV_PRIME 0x100000001b3ULL
+
+static size_t jni_method_cache_hash(size_t class_index, const char *name, const char *signature) {
+  uint64_t hash = JNI_CACHE_FNV_OFFSET_BASIS ^ (uint64_t)class_index;
+  hash *= JNI_CACHE_FNV_PRIME;
+
+  for (const char *c = name; *c; c++) {
+    hash ^= (uint8_t)*c;
+    hash *= JNI_CACHE_FNV_PRIME;
+  }
+
+  /* INFO: Separator, so that ("ab", "c") and ("a", "bc") differ */
+  hash *= JNI_CACHE_FNV_PRIME;
+
+  for (const char *c = signature; *c; c++) {
+    hash ^= (uint8_t)*c;
+    hash *= JNI_CACHE_FNV_PRIME;
+  }
+
+  return (size_t)hash;
+}
+
+static ssize_t jni_class_cache_get(JNIEnv *env, const char *class_name) {
+  for (size_t i = 0; i < jni_class_cache_count; i++) {
+    if (strcmp(jni_class_cache[i].name, class_name) == 0) return (ssize_t)i;
+  }
+
+  jclass local = (*env)->FindClass(env, class_name);
+  if (!local) {
     (*env)->ExceptionClear(env);
 
-    memset(methods, 0, numMethods * sizeof(JNINativeMethod));
+    return -1;
+  }
 
-    return;
+  struct jni_class_cache_entry *new_cache = realloc(jni_class_cache, (jni_class_cache_count + 1) * sizeof(struct jni_class_cache_entry));
+  if (!new_cache) {
+    LOGE("Failed to reallocate buffer for JNI class cache");
+
+    (*env)->DeleteLocalRef(env, local);
+
+    return -1;
   }
+  jni_class_cache = new_cache;
 
-  JNINativeMethod hooks[32];
-  size_t hooks_count = 0;
+  char *name = strdup(class_name);
+  jclass global = (*env)->NewGlobalRef(env, local);
+  (*env)->DeleteLocalRef(env, local);
 
-  for (int i = 0; i < numMethods; i++) {
-    bool is_static = false;
+  if (!name || !global) {
+    LOGE("Failed to cache JNI class %s", class_name);
 
-    JNINativeMethod *nm = &methods[i];
-    jmethodID mid = (*env)->GetMethodID(env, clazz, nm->name, nm->signature);
-    if (!mid) {
-      (*env)->ExceptionClear(env);
-      mid = (*env)->GetStaticMethodID(env, clazz, nm->name, nm->signature);
-      is_static = true;
-    }
+    free(name);
+    if (global) (*env)->DeleteGlobalRef(env, global);
 
-    if (!mid) {
-      (*env)->ExceptionClear(env);
-      nm->fnPtr = NULL;
+    return -1;
+  }
 
-      continue;
-    }
+  jni_class_cache[jni_class_cache_count].name = name;
+  jni_class_cache[jni_class_cache_count].clazz = (jclass)global;
+
+  return (ssize_t)jni_class_cache_count++;
+}
+
+static jclass jni_class_cache_find(JNIEnv *env, const char *class_name) {
+  ssize_t class_index = jni_class_cache_get(env, class_name);
+
+  return class_index != -1 ? jni_class_cache[class_index].clazz : NULL;
+}
+
+static bool jni_method_cache_grow(void) {
+  size_t new_size = jni_method_cache_size ? jni_method_cache_size * 2 : 64;
+  struct jni_method_cache_entry *new_cache = calloc(new_size, sizeof(struct jni_method_cache_entry));
+  if (!new_cache) {
+    LOGE("Failed to allocate memory for JNI method cache");
+
+    return false;
+  }
+
+  for (size_t i = 0; i < jni_method_cache_size; i++) {
+    struct jni_method_cache_entry *entry = &jni_method_cache[i];
+    if (!entry->name) continue;
+
+    size_t slot = jni_method_cache_hash(entry->class_index, entry->name, entry->signature) & (new_size - 1);
+    while (new_cache[slot].name) slot = (slot + 1) & (new_size - 1);
+
+    new_cache[slot] = *entry;
+  }
+
+  free(jni_method_cache);
+  jni_method_cache = new_cache;
+  jni_method_cache_size = new_size;
+
+  return true;
+}
+
+static bool jni_method_is_native(JNIEnv *env, jclass clazz, jmethodID mid, bool is_static, void **art_method) {
+  jobject method = (*env)->ToReflectedMethod(env, clazz, mid, is_static);
+  if (!method) {
+    (*env)->ExceptionClear(env);
+
+    return false;
+  }
 
-    jobject method = (*env)->ToReflectedMethod(env, clazz, mid, is_static);
+  bool is_native = false;
+  if (access_flags_usable) {
+    /* INFO: Reads the flags from ArtMethod instead of calling into Java */
+    *art_method = amethod_from_reflected_method(env, method);
+    is_native = *art_method && (amethod_get_access_flags((uintptr_t)*art_method) & ART_ACC_NATIVE) != 0;
+  } else {
     jint modifier = (*env)->CallIntMethod(env, method, member_getModifiers);
     if ((*env)->ExceptionCheck(env) || (modifier & MODIFIER_NATIVE) == 0) {
       (*env)->ExceptionClear(env);
-      nm->fnPtr = NULL;
+    } else {
+      *art_method = amethod_from_reflected_method(env, method);
+      is_native = true;
+    }
+  }
 
-      (*env)->DeleteLocalRef(env, method);
+  (*env)->DeleteLocalRef(env, method);
 
-      continue;
+  return is_native;
+}
+
+/* INFO: Returns the cached resolution of the method, resolving it on a miss. Methods
+           that do not exist or are not native are cached too, with is_native false. */
+static const struct jni_method_cache_entry *jni_method_cache_get(JNIEnv *env, size_t class_index, const char *name, const char *signature) {
+  size_t slot = 0;
+  if (jni_method_cache_size != 0) {
+    slot = jni_method_cache_hash(class_index, name, signature) & (jni_method_cache_size - 1);
+    while (jni_method_cache[slot].name) {
+      struct jni_method_cache_entry *entry = &jni_method_cache[slot];
+      if (entry->class_index == class_index && strcmp(entry->name, name) == 0 && strcmp(entry->signature, signature) == 0)
+        return entry;
+
+      slot = (slot + 1) & (jni_method_cache_size - 1);
     }
+  }
 
-    void *art_method = amethod_from_reflected_method(env, method);
-    if (hooks_count < 32)
-      hooks[hooks_count++] = *nm;
+  jclass clazz = jni_class_cache[class_index].clazz;
 
-    void *orig = amethod_get_data((uintptr_t)art_method);
-    nm->fnPtr = orig;
+  bool is_static = false;
+  jmethodID mid = (*env)->GetMethodID(env, clazz, name, signature);
+  if (!mid) {
+    (*env)->ExceptionClear(env);
+    mid = (*env)->GetStaticMethodID(env, clazz, name, signature);
+    is_static = true;
+  }
+
+  struct jni_method_cache_entry resolved = {
+    .class_index = class_index,
+    .art_method = NULL,
+    .is_native = false
+  };
+
+  if (!mid) (*env)->ExceptionClear(env);
+  else resolved.is_native = jni_method_is_native(env, clazz, mid, is_static, &resolved.art_method);
+
+  /* INFO: Serve this one uncached if the cache cannot hold it */
+  static struct jni_method_cache_entry uncached;
+
+  if ((jni_method_cache_count + 1) * 2 > jni_method_cache_size && !jni_method_cache_grow()) {
+    uncached = resolved;
+
+    return &uncached;
+  }
+
+  resolved.name = strdup(name);
+  resolved.signature = strdup(signature);
+  if (!resolved.name || !resolved.signature) {
+    LOGE("Failed to duplicate JNI method %s%s for cache", name, signature);
+
+    free(resolved.name);
+    free(resolved.signature);
+
+    uncached = resolved;
+
+    return &uncached;
+  }
+
+  slot = jni_method_cache_hash(class_index, name, signature) & (jni_method_cache_size - 1);
+  while (jni_method_cache[slot].name) slot = (slot + 1) & (jni_method_cache_size - 1);
+
+  jni_method_cache[slot] = resolved;
+  jni_method_cache_count++;
+
+  return &jni_method_cache[slot];
+}
 
-    LOGV("replaced %s %s orig %p: %s", clz, nm->name, orig, nm->signature);
+static void jni_cache_clear(JNIEnv *env) {
+  for (size_t i = 0; i < jni_method_cache_size; i++) {
+    free(jni_method_cache[i].name);
+    free(jni_method_cache[i].signature);
+  }
+
+  free(jni_method_cache);
+  jni_method_cache = NULL;
+  jni_method_cache_size = 0;
+  jni_method_cache_count = 0;
+
+  for (size_t i = 0; i < jni_class_cache_count; i++) {
+    (*env)->DeleteGlobalRef(env, jni_class_cache[i].clazz);
+    free(jni_class_cache[i].name);
+  }
+
+  free(jni_class_cache);
+  jni_class_cache = NULL;
+  jni_class_cache_count = 0;
+}
+
+/* INFO: Hooks of one class, resolved one method array at a time and then
+           registered with a single RegisterNatives. */
+struct jni_hook_batch {
+  const char *class_name;
+  ssize_t class_index;
+  JNINativeMethod *hooks;
+  size_t hooks_count;
+};
 
-    (*env)->DeleteLocalRef(env, method);
+static void jni_hook_batch_init(JNIEnv *env, struct jni_hook_batch *batch, const char *class_name) {
+  batch->class_name = class_name;
+  batch->class_index = can_hook_jni ? jni_class_cache_get(env, class_name) : -1;
+  batch->hooks = NULL;
+  batch->hooks_count = 0;
+}
+
+/* INFO: Replaces the fnPtr of each method with its current native entry, or NULL
+           if it can not be hooked, queueing the hook to be registered. */
+static void jni_hook_batch_add(JNIEnv *env, struct jni_hook_batch *batch, JNINativeMethod *methods, int numMethods) {
+  if (batch->class_index == -1) {
+    memset(methods, 0, numMethods * sizeof(JNINativeMethod));
+
+    return;
   }
 
-  if (hooks_count == 0) {
-    (*env)->DeleteLocalRef(env, clazz);
+  JNINativeMethod *new_hooks = realloc(batch->hooks, (batch->hooks_count + (size_t)numMethods) * sizeof(JNINativeMethod));
+  if (!new_hooks) {
+    LOGE("Failed to reallocate buffer for JNI hooks of %s", batch->class_name);
+
+    for (int i = 0; i < numMethods; i++) methods[i].fnPtr = NULL;
 
     return;
   }
+  batch->hooks = new_hooks;
+
+  for (int i = 0; i < numMethods; i++) {
+    JNINativeMethod *nm = &methods[i];
+
+    const struct jni_method_cache_entry *resolved = jni_method_cache_get(env, (size_t)batch->class_index, nm->name, nm->signature);
+    if (!resolved->is_native) {
+      nm->fnPtr = NULL;
+
+      continue;
+    }
+
+    batch->hooks[batch->hooks_count++] = *nm;
+
+    void *orig = amethod_get_data((uintptr_t)resolved->art_method);
+    nm->fnPtr = orig;
+
+    LOGV("replaced %s %s orig %p: %s", batch->class_name, nm->name, orig, nm->signature);
+  }
+}
+
+static void jni_hook_batch_commit(JNIEnv *env, struct jni_hook_batch *batch) {
+  if (batch->hooks_count != 0) {
+    jclass clazz = jni_class_cache[batch->class_index].clazz;
+    if ((*env)->RegisterNatives(env, clazz, batch->hooks, (jint)batch->hooks_count) != 0) {
+      LOGE("Failed to register %zu JNI hook(s) of %s", batch->hooks_count, batch->class_name);
+
+      (*env)->ExceptionClear(env);
+    }
+  }
+
+  free(batch->hooks);
+  batch->hooks = NULL;
+  batch->hooks_count = 0;
+}
+
+void hook_jni_methods(JNIEnv *env, const char *clz, JNINativeMethod *methods, int numMethods) {
+  if (!can_hook_jni) return;
 
-  (*env)->RegisterNatives(env, clazz, hooks, (jint)hooks_count);
-  (*env)->DeleteLocalRef(env, clazz);
+  struct jni_hook_batch batch;
+  jni_hook_batch_init(env, &batch, clz);
+  jni_hook_batch_add(env, &batch, methods, numMethods);
+  jni_hook_batch_commit(env, &batch);
 }
 
 /* INFO: JNI method hook definitions */
@@ -450,15 +983,17 @@ void hook_jni_methods(JNIEnv *env, const char *clz, JNINativeMethod *methods, in
 static void initialize_jni_hook(void) {
   jint (*get_created_java_vms)(JavaVM **, jsize, jsize *) = (jint (*)(JavaVM **, jsize, jsize *))dlsym(RTLD_DEFAULT, "JNI_GetCreatedJavaVMs");
   if (!get_created_java_vms) {
-    struct maps_info *maps = parse_maps_safe("self");
+    const struct maps_snapshot *maps = maps_snapshot_get();
     if (!maps) {
       LOGE("Failed to scan maps for plt_hook_register_v4");
 
+      parse_maps_self_close();
+
       return;
     }
 
     for (size_t i = 0; i < maps->length; i++) {
-      struct map_entry *map = &maps->maps[i];
+      const struct map_entry *map = &maps->maps[i];
       if (map->path && !strstr(map->path, "/libnativehelper.so")) continue;
 
       /* TODO: Add RTLD_NOLOAD? */
@@ -475,7 +1010,10 @@ static void initialize_jni_hook(void) {
       break;
     }
 
-    free_maps(maps);
+    /* INFO: This runs in Zygote, which aborts on fork if unknown fds are open,
+               and whose snapshot would be stale in every child anyway. */
+    maps_snapshot_invalidate();
+    parse_maps_self_close();
 
     if (!get_created_java_vms) {
       LOGE("Failed to find JNI_GetCreatedJavaVMs");
@@ -513,6 +1051,8 @@ static void initialize_jni_hook(void) {
     return;
   }
 
+  amethod_init_access_flags(env, member_getModifiers, MODIFIER_NATIVE);
+
   can_hook_jni = true;
   do_hook_zygote(env);
 }
@@ -521,12 +1061,12 @@ static void initialize_jni_hook(void) {
 static void api_plt_hook_register(const char *regex, const char *symbol, void *fn, void **backup) {
   if (!g_ctx || !regex || !symbol || !fn || g_ctx->register_info_count >= MAX_REGISTER_INFO) return;
 
-  regex_t re;
-  if (regcomp(&re, regex, REG_NOSUB) != 0) return;
+  struct plt_matcher_pattern matcher;
+  if (!plt_matcher_compile(&matcher, regex)) return;
 
   pthread_mutex_lock(&g_ctx->hook_info_lock);
 
-  g_ctx->register_info[g_ctx->register_info_count].regex = re;
+  g_ctx->register_info[g_ctx->register_info_count].matcher = matcher;
   g_ctx->register_info[g_ctx->register_info_count].symbol = strdup(symbol);
   g_ctx->register_info[g_ctx->register_info_count].callback = fn;
   g_ctx->register_info[g_ctx->register_info_count].backup = backup;
@@ -538,12 +1078,12 @@ static void api_plt_hook_register(const char *regex, const char *symbol, void *f
 static void api_plt_hook_exclude(const char *regex, const char *symbol) {
   if (!g_ctx || !regex || g_ctx->ignore_info_count >= MAX_IGNORE_INFO) return;
 
-  regex_t re;
-  if (regcomp(&re, regex, REG_NOSUB) != 0) return;
+  struct plt_matcher_pattern matcher;
+  if (!plt_matcher_compile(&matcher, regex)) return;
 
   pthread_mutex_lock(&g_ctx->hook_info_lock);
 
-  g_ctx->ignore_info[g_ctx->ignore_info_count].regex = re;
+  g_ctx->ignore_info[g_ctx->ignore_info_count].matcher = matcher;
   g_ctx->ignore_info[g_ctx->ignore_info_count].symbol = symbol ? strdup(symbol) : NULL;
   g_ctx->ignore_info_count++;
 
@@ -555,7 +1095,7 @@ static bool api_plt_hook_commit(void) {
 
   pthread_mutex_lock(&g_ctx->hook_info_lock);
 
-  struct maps_info *map_infos = parse_maps_safe("self");
+  const struct maps_snapshot *map_infos = maps_snapshot_get();
   if (!map_infos) {
     LOGE("Failed to scan maps for self");
 
@@ -564,19 +1104,32 @@ static bool api_plt_hook_commit(void) {
     return false;
   }
 
+  /* INFO: Each library is matched once, even if several of its mappings qualify */
+  uint8_t *visited_paths = calloc(map_infos->paths_count, sizeof(uint8_t));
+  if (!visited_paths) {
+    LOGE("Failed to allocate memory for visited paths");
+
+    pthread_mutex_unlock(&g_ctx->hook_info_lock);
+
+    return false;
+  }
+
   bool any_failed = false;
   for (size_t i = 0; i < map_infos->length; i++) {
-    struct map_entry *map = &map_infos->maps[i];
+    const struct map_entry *map = &map_infos->maps[i];
     if (map->offset != 0 || !map->is_private || !(map->perms & PROT_READ)) continue;
 
+    if (visited_paths[map_infos->path_ids[i]]) continue;
+    visited_paths[map_infos->path_ids[i]] = 1;
+
     for (size_t r = 0; r < g_ctx->register_info_count; r++) {
       struct register_info *reg = &g_ctx->register_info[r];
-      if (regexec(&reg->regex, map->path, 0, NULL, 0) != 0) continue;
+      if (!plt_matcher_match(&reg->matcher, map->path)) continue;
 
       bool ignored = false;
       for (size_t ig = 0; ig < g_ctx->ignore_info_count; ig++) {
         struct ignore_info *ign = &g_ctx->ignore_info[ig];
-        if (regexec(&ign->regex, map->path, 0, NULL, 0) != 0) continue;
+        if (!plt_matcher_match(&ign->matcher, map->path)) continue;
         if (ign->symbol && strcmp(ign->symbol, reg->symbol) != 0) continue;
 
         ignored = true;
@@ -592,17 +1145,17 @@ static bool api_plt_hook_commit(void) {
     }
   }
 
-  free_maps(map_infos);
+  free(visited_paths);
 
   /* INFO: Clear register_info and ignore_info */
   for (size_t i = 0; i < g_ctx->register_info_count; i++) {
-    regfree(&g_ctx->register_info[i].regex);
+    plt_matcher_free(&g_ctx->register_info[i].matcher);
     free(g_ctx->register_info[i].symbol);
   }
   g_ctx->register_info_count = 0;
 
   for (size_t i = 0; i < g_ctx->ignore_info_count; i++) {
-    regfree(&g_ctx->ignore_info[i].regex);
+    plt_matcher_free(&g_ctx->ignore_info[i].matcher);
     free(g_ctx->ignore_info[i].symbol);
   }
   g_ctx->ignore_info_count = 0;
@@ -615,89 +1168,95 @@ static bool api_plt_hook_commit(void) {
 static void api_plt_hook_register_v4(dev_t dev, ino_t inode, const char *symbol, void *fn, void **backup) {
   if (!g_ctx || !symbol || !fn) return;
 
-  struct maps_info *maps = parse_maps_safe("self");
-  if (!maps) {
-    LOGE("Failed to scan maps for plt_hook_register_v4");
+  char *symbol_copy = strdup(symbol);
+  if (!symbol_copy) {
+    LOGE("Failed to duplicate symbol name for hook %s", symbol);
 
     return;
   }
 
-  uintptr_t lib_start = 0;
-  const char *lib_path = NULL;
-  for (size_t i = 0; i < maps->length; i++) {
-    struct map_entry *entry = &maps->maps[i];
-    if (entry->dev != dev || entry->inode != inode) continue;
-
-    lib_start = entry->start;
-    lib_path = entry->path;
-
-    break;
-  }
-
-  if (!lib_path) {
-    LOGE("Failed to find library with dev %zu and inode %zu for hook %s", (size_t)dev, (size_t)inode, symbol);
+  if (!plt_hook_list_add(dev, inode, symbol_copy, fn, backup)) {
+    LOGE("Failed to add plt_hook entry for %s", symbol);
 
-    free_maps(maps);
+    free(symbol_copy);
 
     return;
   }
+}
+
+static void api_exempt_fd(int fd) {
+  if (!g_ctx) return;
 
-  char *lib_path_copy = strdup(lib_path);
-  if (!lib_path_copy) {
-    LOGE("Failed to duplicate library path for hook %s: %s", symbol, lib_path);
+  if (FLAG_GET(g_ctx, POST_SPECIALIZE) || FLAG_GET(g_ctx, SKIP_FD_SANITIZATION)) return;
+  if (!FLAG_GET(g_ctx, APP_FORK_AND_SPECIALIZE)) return;
 
-    free_maps(maps);
+  int *exempted_fds = (int *)realloc(g_ctx->exempted_fds, (g_ctx->exempted_fds_count + 1) * sizeof(int));
+  if (!exempted_fds) {
+    LOGE("Failed to allocate memory for exempted fd %d", fd);
 
     return;
   }
 
-  free_maps(maps);
-
-  if (!plti_add_manual_lib(&plti_ctx, lib_path_copy, lib_start)) {
-    LOGE("Failed to add manual library for hook %s: %s", symbol, lib_path_copy);
+  g_ctx->exempted_fds = exempted_fds;
+  g_ctx->exempted_fds[g_ctx->exempted_fds_count++] = fd;
 
-    free(lib_path_copy);
+  return;
+}
 
-    return;
-  }
+/* INFO: Resolves every library with hooks registered to it to its path and base,
+           once per library however many of its symbols are hooked. */
+static bool plt_hook_list_resolve(void) {
+  const struct maps_snapshot *maps = maps_snapshot_get();
+  if (!maps) {
+    LOGE("Failed to scan maps for plt_hook_commit");
 
-  char *symbol_copy = strdup(symbol);
-  if (!symbol_copy) {
-    LOGE("Failed to duplicate symbol name for hook %s in %s", symbol, lib_path_copy);
+    return false;
+  }
 
-    free(lib_path_copy);
+  bool any_failed = false;
+  for (size_t i = 0; i < plt_hook_list_count; i++) {
+    struct plt_hook_entry *entry = &plt_hook_list[i];
+    if (entry->resolved) continue;
 
-    return;
-  }
+    char *lib_path = NULL;
 
-  if (!plt_hook_list_add(lib_path_copy, symbol_copy, fn, backup)) {
-    LOGE("Failed to add plt_hook entry for %s in %s", symbol, lib_path_copy);
+    const struct map_entry *lib = maps_snapshot_find_inode(maps, entry->dev, entry->inode);
+    if (!lib) {
+      LOGE("Failed to find library with dev %zu and inode %zu for hook %s", (size_t)entry->dev, (size_t)entry->inode, entry->symbol);
+    } else if (!(lib_path = strdup(lib->path))) {
+      LOGE("Failed to duplicate library path for hook %s: %s", entry->symbol, lib->path);
+    } else if (!plti_add_manual_lib(&plti_ctx, lib_path, lib->start)) {
+      LOGE("Failed to add manual library for hook %s: %s", entry->symbol, lib_path);
 
-    free(lib_path_copy);
-    free(symbol_copy);
+      free(lib_path);
+      lib_path = NULL;
+    }
 
-    return;
-  }
-}
+    if (!lib_path) any_failed = true;
 
-static void api_exempt_fd(int fd) {
-  if (!g_ctx) return;
+    /* INFO: Every later hook in the same library shares this result */
+    for (size_t j = i; j < plt_hook_list_count; j++) {
+      struct plt_hook_entry *other = &plt_hook_list[j];
+      if (other->dev != entry->dev || other->inode != entry->inode) continue;
 
-  if (FLAG_GET(g_ctx, POST_SPECIALIZE) || FLAG_GET(g_ctx, SKIP_FD_SANITIZATION)) return;
-  if (!FLAG_GET(g_ctx, APP_FORK_AND_SPECIALIZE)) return;
-  if (g_ctx->exempted_fds_count >= MAX_EXEMPTED_FDS) return;
+      other->lib_path = lib_path;
+      other->resolved = true;
+    }
 
-  g_ctx->exempted_fds[g_ctx->exempted_fds_count++] = fd;
+    entry->owns_lib_path = lib_path != NULL;
+  }
 
-  return;
+  return !any_failed;
 }
 
 static bool api_plt_hook_commit_v4(void) {
   if (!g_ctx) return false;
 
-  bool any_failed = false;
+  bool any_failed = plt_hook_list_count > 0 && !plt_hook_list_resolve();
   for (size_t i = 0; i < plt_hook_list_count; i++) {
     struct plt_hook_entry *entry = &plt_hook_list[i];
+    if (!entry->lib_path) continue;
+
     if (!plti_add_hook(&plti_ctx, entry->lib_path, entry->symbol, entry->new_func, entry->backup)) {
       LOGE("Failed to register plt_hook \"%s\" in %s with PLTI", entry->symbol, entry->lib_path);
 
@@ -705,18 +1264,117 @@ static bool api_plt_hook_commit_v4(void) {
     }
   }
 
-  if (plt_hook_list) {
-    for (size_t i = 0; i < plt_hook_list_count; i++) {
-      free((void *)plt_hook_list[i].lib_path);
-      free((void *)plt_hook_list[i].symbol);
+  plt_hook_list_clear();
+
+  return !any_failed;
+}
+
+/* INFO: Process filters of the modules, indexed by their position in ReZygiskd's list.
+           Modules set them from children, in onLoad, so they live in a shared mapping
+           created by Zygote, letting later children skip the module entirely. Children
+           unmap it at cleanup, before any app code runs. */
+#define MODULE_FILTER_MAX_UID_RANGES 8
+#define MODULE_FILTER_PREFIXES_SIZE 512
+#define APP_ID_USER_OFFSET 100000
+
+enum module_filter_state {
+  MODULE_FILTER_EMPTY,
+  MODULE_FILTER_WRITING,
+  MODULE_FILTER_READY
+};
+
+struct module_filter {
+  uint32_t state;
+  uint32_t flags;
+  uint32_t uid_ranges_count;
+  struct rezygisk_uid_range uid_ranges[MODULE_FILTER_MAX_UID_RANGES];
+  uint32_t process_prefixes_count;
+  /* INFO: Prefixes one after another, each NUL terminated */
+  char process_prefixes[MODULE_FILTER_PREFIXES_SIZE];
+};
+
+struct module_filter_target {
+  bool is_server;
+  uid_t app_id;
+  const char *process;
+  bool root_granted;
+};
+
+static struct module_filter *module_filters = NULL;
+static size_t module_filters_count = 0;
+
+static void module_filters_init(size_t count) {
+  if (count == 0) return;
+
+  void *filters = mmap(NULL, count * sizeof(struct module_filter), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (filters == MAP_FAILED) {
+    PLOGE("allocate module filters");
+
+    return;
+  }
+
+  module_filters = (struct module_filter *)filters;
+  module_filters_count = count;
+}
+
+static void module_filters_unmap(void) {
+  if (!module_filters) return;
+
+  munmap(module_filters, module_filters_count * sizeof(struct module_filter));
+  module_filters = NULL;
+  module_filters_count = 0;
+}
+
+static void module_filter_target_get(struct zygisk_context *ctx, struct module_filter_target *target) {
+  memset(target, 0, sizeof(*target));
+
+  if (FLAG_GET(ctx, SERVER_FORK_AND_SPECIALIZE)) {
+    target->is_server = true;
+
+    return;
+  }
+
+  target->app_id = (uid_t)*ctx->args.app->uid % APP_ID_USER_OFFSET;
+  target->process = ctx->process;
+  target->root_granted = (ctx->info_flags & PROCESS_GRANTED_ROOT) == PROCESS_GRANTED_ROOT;
+}
+
+/* INFO: Modules without a filter run everywhere */
+static bool module_filter_allows(size_t index, const struct module_filter_target *target) {
+  if (!module_filters || index >= module_filters_count) return true;
+
+  const struct module_filter *filter = &module_filters[index];
+  if (__atomic_load_n(&filter->state, __ATOMIC_ACQUIRE) != MODULE_FILTER_READY) return true;
+
+  if (target->is_server) return (filter->flags & FILTER_SYSTEM_SERVER) == FILTER_SYSTEM_SERVER;
+
+  if ((filter->flags & FILTER_APPS) == 0) return false;
+  if ((filter->flags & FILTER_ROOT_GRANTED_ONLY) == FILTER_ROOT_GRANTED_ONLY && !target->root_granted) return false;
+
+  if (filter->uid_ranges_count > 0) {
+    bool in_range = false;
+    for (uint32_t i = 0; i < filter->uid_ranges_count && !in_range; i++) {
+      in_range = target->app_id >= filter->uid_ranges[i].first && target->app_id <= filter->uid_ranges[i].last;
+    }
+
+    if (!in_range) return false;
+  }
+
+  if (filter->process_prefixes_count > 0) {
+    if (!target->process) return false;
+
+    const char *prefix = filter->process_prefixes;
+    for (uint32_t i = 0; i < filter->process_prefixes_count; i++) {
+      size_t prefix_len = strlen(prefix);
+      if (strncmp(target->process, prefix, prefix_len) == 0) return true;
+
+      prefix += prefix_len + 1;
     }
 
-    free(plt_hook_list);
-    plt_hook_list = NULL;
-    plt_hook_list_count = 0;
+    return false;
   }
 
-  return !any_failed;
+  return true;
 }
 
 /* INFO: Avoid common mistakes of not utilizing implementation member (impl) when calling
@@ -734,7 +1392,7 @@ static int api_connect_companion(void *id) {
     return -1;
   }
 
-  return rezygiskd_connect_companion(DECODE_ID(id));
+  return rezygiskd_connect_companion(zygisk_modules[DECODE_ID(id)].index);
 }
 
 static void api_set_option(void *id, enum rezygisk_options opt) {
@@ -770,7 +1428,7 @@ static int api_get_module_dir(void *id) {
     return -1;
   }
 
-  return rezygiskd_get_module_dir(DECODE_ID(id));
+  return rezygiskd_get_module_dir(zygisk_modules[DECODE_ID(id)].index);
 }
 
 static uint32_t api_get_flags(void) {
@@ -779,6 +1437,61 @@ static uint32_t api_get_flags(void) {
   return (g_ctx->info_flags & ~PRIVATE_MASK);
 }
 
+static bool api_set_process_filter(void *id, const struct rezygisk_process_filter *filter) {
+  if (!g_ctx || !filter) return false;
+
+  if ((size_t)id < RZID_MAGIC || (size_t)id >= RZID_MAGIC + zygisk_module_length) {
+    LOGE("Invalid (encoded) module id %zu", (size_t)id);
+
+    return false;
+  }
+
+  size_t index = zygisk_modules[DECODE_ID(id)].index;
+  if (!module_filters || index >= module_filters_count) return false;
+
+  if (filter->uid_ranges_count > MODULE_FILTER_MAX_UID_RANGES) {
+    LOGE("Process filter has too many uid ranges: %zu", filter->uid_ranges_count);
+
+    return false;
+  }
+
+  size_t prefixes_size = 0;
+  for (size_t i = 0; i < filter->process_prefixes_count; i++) {
+    prefixes_size += strlen(filter->process_prefixes[i]) + 1;
+  }
+
+  if (prefixes_size > MODULE_FILTER_PREFIXES_SIZE) {
+    LOGE("Process filter prefixes take too much space: %zu", prefixes_size);
+
+    return false;
+  }
+
+  /* INFO: Only the first filter is kept, as every child sets it again */
+  struct module_filter *slot = &module_filters[index];
+  uint32_t expected = MODULE_FILTER_EMPTY;
+  if (!__atomic_compare_exchange_n(&slot->state, &expected, MODULE_FILTER_WRITING, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    return true;
+
+  slot->flags = filter->flags;
+
+  slot->uid_ranges_count = (uint32_t)filter->uid_ranges_count;
+  if (filter->uid_ranges_count > 0)
+    memcpy(slot->uid_ranges, filter->uid_ranges, filter->uid_ranges_count * sizeof(struct rezygisk_uid_range));
+
+  char *prefix = slot->process_prefixes;
+  for (size_t i = 0; i < filter->process_prefixes_count; i++) {
+    size_t prefix_len = strlen(filter->process_prefixes[i]);
+    memcpy(prefix, filter->process_prefixes[i], prefix_len + 1);
+
+    prefix += prefix_len + 1;
+  }
+  slot->process_prefixes_count = (uint32_t)filter->process_prefixes_count;
+
+  __atomic_store_n(&slot->state, MODULE_FILTER_READY, __ATOMIC_RELEASE);
+
+  return true;
+}
+
 bool rezygisk_module_register(struct rezygisk_api *api, struct rezygisk_abi const *target_module) {
   if (!g_ctx || !api || !target_module || target_module->api_version > REZYGISK_API_VERSION) return false;
 
@@ -807,6 +1520,8 @@ bool rezygisk_module_register(struct rezygisk_api *api, struct rezygisk_abi cons
     api->get_flags = api_get_flags;
   }
 
+  if (target_module->api_version >= 6) api->set_process_filter = api_set_process_filter;
+
   return true;
 }
 
@@ -821,63 +1536,368 @@ static int sigmask(int how, int signum) {
 
 static bool load_modules_only(void);
 
-static void rz_fork_pre(struct zygisk_context *ctx) {
-  /* INFO: Do our own fork before loading any 3rd party code.
-              First block SIGCHLD, unblock after original fork is done.
-  */
-  sigmask(SIG_BLOCK, SIGCHLD);
-  ctx->pid = old_fork();
-  if (ctx->pid != 0 || FLAG_GET(ctx, SKIP_FD_SANITIZATION)) return;
+static inline void fd_bitmap_set(struct fd_bitmap *bitmap, int fd) {
+  if (fd < 0 || (size_t)fd / FD_BITMAP_WORD_BITS >= bitmap->words_count) return;
+
+  bitmap->words[(size_t)fd / FD_BITMAP_WORD_BITS] |= 1UL << ((size_t)fd % FD_BITMAP_WORD_BITS);
+}
+
+static inline void fd_bitmap_unset(struct fd_bitmap *bitmap, int fd) {
+  if (fd < 0 || (size_t)fd / FD_BITMAP_WORD_BITS >= bitmap->words_count) return;
+
+  bitmap->words[(size_t)fd / FD_BITMAP_WORD_BITS] &= ~(1UL << ((size_t)fd % FD_BITMAP_WORD_BITS));
+}
+
+static inline bool fd_bitmap_get(const struct fd_bitmap *bitmap, int fd) {
+  if (fd < 0 || (size_t)fd / FD_BITMAP_WORD_BITS >= bitmap->words_count) return false;
+
+  return (bitmap->words[(size_t)fd / FD_BITMAP_WORD_BITS] >> ((size_t)fd % FD_BITMAP_WORD_BITS)) & 1;
+}
+
+static inline size_t fd_bitmap_capacity(const struct fd_bitmap *bitmap) {
+  return bitmap->words_count * FD_BITMAP_WORD_BITS;
+}
+
+/* INFO: Grows the bitmap so that it can hold fd, returning false if it can't */
+static bool fd_bitmap_reserve(struct fd_bitmap *bitmap, int fd) {
+  if (fd < 0 || (size_t)fd >= FD_BITMAP_MAX_FDS) return false;
+  if ((size_t)fd < fd_bitmap_capacity(bitmap)) return true;
+
+  size_t words_count = bitmap->words_count ? bitmap->words_count * 2 : 1;
+  while (words_count * FD_BITMAP_WORD_BITS <= (size_t)fd) words_count *= 2;
+  if (words_count * FD_BITMAP_WORD_BITS > FD_BITMAP_MAX_FDS) words_count = FD_BITMAP_MAX_FDS / FD_BITMAP_WORD_BITS;
+
+  unsigned long *words = (unsigned long *)realloc(bitmap->words, words_count * sizeof(unsigned long));
+  if (!words) {
+    LOGE("Failed to grow the fd bitmap to %zu words", words_count);
+
+    return false;
+  }
+
+  memset(words + bitmap->words_count, 0, (words_count - bitmap->words_count) * sizeof(unsigned long));
+  bitmap->words = words;
+  bitmap->words_count = words_count;
+
+  return true;
+}
+
+/* INFO: Marks fd as allowed, returning false if it can't be recorded, in which
+           case sanitizing would close it. */
+static inline bool fd_bitmap_allow(struct fd_bitmap *bitmap, int fd) {
+  if (!fd_bitmap_reserve(bitmap, fd)) return false;
+
+  fd_bitmap_set(bitmap, fd);
+
+  return true;
+}
+
+/* INFO: Zygote's own open fds, which are the ones every child is allowed to keep.
+           They are scanned from /proc/self/fd once. On kernels that report the
+           open fd count, every later fork only revalidates them with fcntl, which
+           is far cheaper than a procfs walk, falling back to the scan whenever the
+           count doesn't confirm the probe. Other kernels scan before every fork. */
+static struct fd_bitmap zygote_fds = { NULL, 0 };
+static int zygote_fds_max = -1;
+static bool zygote_fds_scanned = false;
+static bool close_range_supported = false;
+/* INFO: Whether the size of /proc/self/fd is the count of open fds (Linux 6.2+),
+           the only thing that can confirm the fcntl probe found them all */
+static bool fd_count_supported = false;
+
+/* INFO: How far past the highest known fd to probe for new ones. Fds allocated
+           lowest first land here, while ones dup2'd further up are caught by
+           the open fd count not matching, see zygote_fds_refresh. */
+#define ZYGOTE_FDS_PROBE_SLACK 64
+
+static bool zygote_fds_scan(void) {
+  if (!zygote_fds.words) {
+    struct rlimit limit;
+    size_t max_fds = FD_BITMAP_MAX_FDS;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < FD_BITMAP_MAX_FDS)
+      max_fds = (size_t)limit.rlim_cur;
+
+    zygote_fds.words_count = (max_fds + FD_BITMAP_WORD_BITS - 1) / FD_BITMAP_WORD_BITS;
+    zygote_fds.words = (unsigned long *)calloc(zygote_fds.words_count, sizeof(unsigned long));
+    if (!zygote_fds.words) {
+      LOGE("Failed to allocate memory for the fd bitmap of %zu fds", max_fds);
+
+      zygote_fds.words_count = 0;
+
+      return false;
+    }
+  }
 
-  /* INFO: Record all open fds */
   DIR *dir = opendir("/proc/self/fd");
   if (!dir) {
     PLOGE("Failed to open /proc/self/fd");
 
-    return;
+    return false;
   }
 
+  memset(zygote_fds.words, 0, zygote_fds.words_count * sizeof(unsigned long));
+  zygote_fds_max = -1;
+
+  bool complete = true;
+
+  int dfd = dirfd(dir);
   struct dirent *entry;
   while ((entry = readdir(dir))) {
     int fd = parse_int(entry->d_name);
-    if (fd == -1) continue;
+    if (fd < 0 || fd == dfd) continue;
+
+    /* INFO: An fd missing from the bitmap would be closed in every child, so
+               rather not sanitize at all than use an incomplete allowlist. */
+    if (!fd_bitmap_allow(&zygote_fds, fd)) {
+      LOGE("Zygote fd %d can't be recorded in the fd bitmap", fd);
 
-    if (fd >= MAX_FD_SIZE) {
-      close(fd);
+      complete = false;
 
       continue;
     }
 
-    ctx->allowed_fds[fd] = 1;
+    if (fd > zygote_fds_max) zygote_fds_max = fd;
   }
 
-  /* INFO: The dirfd should not be allowed */
-  int dfd = dirfd(dir);
-  if (dfd >= 0 && dfd < MAX_FD_SIZE) ctx->allowed_fds[dfd] = 0;
-
   closedir(dir);
+
+  return complete;
 }
 
-static void mark_fds_allowed(struct zygisk_context *ctx, JNIEnv *env, jintArray fdsArray) {
-  if (!fdsArray) return;
+static void zygote_fds_refresh(void) {
+  if (!zygote_fds_scanned) {
+    zygote_fds_scanned = zygote_fds_scan();
+
+#ifdef __NR_close_range
+    /* INFO: Closes nothing, only tells whether the kernel (5.9+) has it */
+    close_range_supported = syscall(__NR_close_range, ~0U, ~0U, 0) == 0;
+#endif
+
+    /* INFO: Older kernels report 0, and Zygote always has fds open */
+    struct stat st;
+    fd_count_supported = stat("/proc/self/fd", &st) == 0 && st.st_size > 0;
+
+    return;
+  }
+
+  /* INFO: Without a count to confirm it, the probe would always be followed by the
+             scan anyway, so go straight to it. */
+  if (!fd_count_supported) {
+    zygote_fds_scanned = zygote_fds_scan();
+
+    return;
+  }
+
+  int limit = zygote_fds_max + 1 + ZYGOTE_FDS_PROBE_SLACK;
+  if ((size_t)limit > fd_bitmap_capacity(&zygote_fds)) limit = (int)fd_bitmap_capacity(&zygote_fds);
+
+  int new_max = -1;
+  size_t open_count = 0;
+  for (int fd = 0; fd < limit; fd++) {
+    if (fcntl(fd, F_GETFD) == -1) {
+      fd_bitmap_unset(&zygote_fds, fd);
+
+      continue;
+    }
+
+    fd_bitmap_set(&zygote_fds, fd);
+    new_max = fd;
+    open_count++;
+  }
+
+  /* INFO: The probe can't see fds that dup2 placed past the probed range, so it is
+             only trusted when the open fd count confirms that it found them all. */
+  struct stat st;
+  if (new_max > zygote_fds_max || stat("/proc/self/fd", &st) == -1 || (size_t)st.st_size != open_count) {
+    zygote_fds_scanned = zygote_fds_scan();
+
+    return;
+  }
+
+  zygote_fds_max = new_max;
+}
+
+/* INFO: Data directories of isolated services, mapped to the uid of the app owning
+           them. Filled in Zygote before forking, so that every child inherits it.
+           The spawns of the apps themselves carry both the data directory and the
+           uid, so they correct an entry when a package is reinstalled under a new
+           uid, without any filesystem call. */
+#define DATA_DIR_UID_CACHE_SIZE 32
+
+struct data_dir_uid_entry {
+  char *data_dir;
+  uid_t uid;
+};
+
+static struct data_dir_uid_entry data_dir_uid_cache[DATA_DIR_UID_CACHE_SIZE];
+static size_t data_dir_uid_cache_count = 0;
+static size_t data_dir_uid_cache_next = 0;
+
+static struct data_dir_uid_entry *data_dir_uid_cache_find(const char *data_dir) {
+  for (size_t i = 0; i < data_dir_uid_cache_count; i++) {
+    if (strcmp(data_dir_uid_cache[i].data_dir, data_dir) == 0) return &data_dir_uid_cache[i];
+  }
+
+  return NULL;
+}
+
+static void data_dir_uid_cache_add(const char *data_dir, uid_t uid) {
+  char *data_dir_copy = strdup(data_dir);
+  if (!data_dir_copy) {
+    LOGE("Failed to allocate memory for cached data directory");
+
+    return;
+  }
+
+  /* INFO: Once full, the oldest entry makes room */
+  struct data_dir_uid_entry *entry = &data_dir_uid_cache[data_dir_uid_cache_next];
+  data_dir_uid_cache_next = (data_dir_uid_cache_next + 1) % DATA_DIR_UID_CACHE_SIZE;
+  if (data_dir_uid_cache_count < DATA_DIR_UID_CACHE_SIZE) data_dir_uid_cache_count++;
+  else free(entry->data_dir);
+
+  entry->data_dir = data_dir_copy;
+  entry->uid = uid;
+}
+
+/* INFO: Called for the spawns of non-isolated apps, only updating existing entries */
+static void data_dir_uid_cache_refresh(JNIEnv *env, jstring app_data_dir, uid_t uid) {
+  const char *data_dir = (*env)->GetStringUTFChars(env, app_data_dir, NULL);
+  if (!data_dir) return;
+
+  struct data_dir_uid_entry *entry = data_dir_uid_cache_find(data_dir);
+  if (entry && entry->uid != uid) {
+    LOGD("Data directory %s changed owner from UID %d to %d", data_dir, entry->uid, uid);
+
+    entry->uid = uid;
+  }
+
+  (*env)->ReleaseStringUTFChars(env, app_data_dir, data_dir);
+}
+
+static bool rz_get_flags_uid(struct zygisk_context *ctx, uid_t *out_uid) {
+  /* INFO: Isolated services have different UIDs than the main apps. Because
+              numerous root implementations base themselves in the UID of the
+              app, we need to ensure that the UID sent to ReZygiskd to search
+              is the app's and not the isolated service, or else it will be
+              able to bypass DenyList.
+
+           All apps, and isolated processes, of *third-party* applications will
+             have their app_data_dir set. The system applications might not have
+             one, however it is unlikely they will create an isolated process,
+             and even if so, it should not impact in detections, performance or
+             any area.
+  */
+  uid_t uid = *ctx->args.app->uid;
+  if (!IS_ISOLATED_SERVICE(uid) && ctx->args.app->app_data_dir && data_dir_uid_cache_count > 0)
+    data_dir_uid_cache_refresh(ctx->env, *ctx->args.app->app_data_dir, uid);
+
+  if (IS_ISOLATED_SERVICE(uid) && ctx->args.app->app_data_dir) {
+    /* INFO: If the app is an isolated service, we use the UID of the
+               app's process data directory, which is the UID of the
+               app itself, which root implementations actually use.
+    */
+    const char *data_dir = (*ctx->env)->GetStringUTFChars(ctx->env, *ctx->args.app->app_data_dir, NULL);
+    if (!data_dir) {
+      LOGE("Failed to get app data directory");
+
+      return false;
+    }
+
+    struct data_dir_uid_entry *entry = data_dir_uid_cache_find(data_dir);
+    if (entry) {
+      uid = entry->uid;
+    } else {
+      struct stat st;
+      if (stat(data_dir, &st) == -1) {
+        PLOGE("Failed to stat app data directory [%s]", data_dir);
+
+        (*ctx->env)->ReleaseStringUTFChars(ctx->env, *ctx->args.app->app_data_dir, data_dir);
+
+        return false;
+      }
+
+      uid = st.st_uid;
+      data_dir_uid_cache_add(data_dir, uid);
+    }
+
+    LOGD("Isolated service being related to UID %d, app data dir: %s", uid, data_dir);
+
+    (*ctx->env)->ReleaseStringUTFChars(ctx->env, *ctx->args.app->app_data_dir, data_dir);
+  }
+
+  *out_uid = uid;
+
+  return true;
+}
+
+/* INFO: Everything needed for the flags query is known before forking, so Zygote
+           sends it and lets ReZygiskd answer it while the fork happens. The child
+           inherits the connection and reads the reply from it, and Zygote closes
+           its own copy before it is seen by Zygote's fd table. */
+static void rz_prefetch_process_flags(struct zygisk_context *ctx) {
+  uid_t uid;
+  if (!rz_get_flags_uid(ctx, &uid)) return;
+
+  RZ_TRACE(RZ_TRACE_FLAGS_QUERY_SENT, RZ_TRACE_NO_MODULE, uid);
+  ctx->info_flags_fd = rezygiskd_request_process_flags(uid, ctx->process);
+}
+
+static void rz_fork_pre(struct zygisk_context *ctx) {
+  if (!FLAG_GET(ctx, SKIP_FD_SANITIZATION)) {
+    zygote_fds_refresh();
+
+    /* INFO: Without knowing Zygote's fds, every fd would be seen as leaked */
+    if (!zygote_fds_scanned) FLAG_SET(ctx, SKIP_FD_SANITIZATION);
+  }
+
+  /* INFO: After the fd refresh, so that the connection is not seen as Zygote's */
+  if (FLAG_GET(ctx, APP_FORK_AND_SPECIALIZE)) rz_prefetch_process_flags(ctx);
+
+  /* INFO: Do our own fork before loading any 3rd party code.
+              First block SIGCHLD, unblock after original fork is done.
+  */
+  sigmask(SIG_BLOCK, SIGCHLD);
+  ctx->pid = old_fork();
+  if (ctx->pid == 0) RZ_TRACE(RZ_TRACE_FORK, RZ_TRACE_NO_MODULE, 0);
+
+  /* INFO: Also when the fork failed, as no child will ever read the reply */
+  if (ctx->pid != 0 && ctx->info_flags_fd != -1) {
+    close(ctx->info_flags_fd);
+    ctx->info_flags_fd = -1;
+  }
+
+  if (ctx->pid != 0 || FLAG_GET(ctx, SKIP_FD_SANITIZATION)) return;
+
+  /* INFO: After the fork, this is already the child's own copy of the bitmap,
+             which is therefore free to grow it. */
+  ctx->allowed_fds = zygote_fds;
+}
+
+static bool mark_fds_allowed(struct zygisk_context *ctx, JNIEnv *env, jintArray fdsArray) {
+  if (!fdsArray) return true;
 
   jint *arr = (*env)->GetIntArrayElements(env, fdsArray, NULL);
   jint len = (*env)->GetArrayLength(env, fdsArray);
 
+  bool marked = true;
   for (jint i = 0; i < len; ++i) {
-    int fd = arr[i];
-    if (fd >= 0 && fd < MAX_FD_SIZE) ctx->allowed_fds[fd] = 1;
+    if (!fd_bitmap_allow(&ctx->allowed_fds, arr[i])) marked = false;
   }
 
   (*env)->ReleaseIntArrayElements(env, fdsArray, arr, JNI_ABORT);
+
+  return marked;
 }
 
 static void rz_sanitize_fds(struct zygisk_context *ctx) {
+  /* INFO: Close it before it gets closed behind our back */
+  parse_maps_self_close();
+
   if (FLAG_GET(ctx, SKIP_FD_SANITIZATION)) return;
 
+  bool allowed_fds_complete = true;
   if (FLAG_GET(ctx, APP_FORK_AND_SPECIALIZE)) {
     jintArray fdsToIgnore = ctx->args.app->fds_to_ignore ? *ctx->args.app->fds_to_ignore : NULL;
-    mark_fds_allowed(ctx, ctx->env, fdsToIgnore);
+    if (!mark_fds_allowed(ctx, ctx->env, fdsToIgnore)) allowed_fds_complete = false;
 
     if (ctx->exempted_fds_count > 0) {
       jint len = fdsToIgnore ? (*ctx->env)->GetArrayLength(ctx->env, fdsToIgnore) : 0;
@@ -892,8 +1912,7 @@ static void rz_sanitize_fds(struct zygisk_context *ctx) {
 
         (*ctx->env)->SetIntArrayRegion(ctx->env, newArray, len, (jsize)ctx->exempted_fds_count, ctx->exempted_fds);
         for (size_t i = 0; i < ctx->exempted_fds_count; i++) {
-          int fd = ctx->exempted_fds[i];
-          if (fd >= 0 && fd < MAX_FD_SIZE) ctx->allowed_fds[fd] = 1;
+          if (!fd_bitmap_allow(&ctx->allowed_fds, ctx->exempted_fds[i])) allowed_fds_complete = false;
         }
 
         *ctx->args.app->fds_to_ignore = newArray;
@@ -904,7 +1923,46 @@ static void rz_sanitize_fds(struct zygisk_context *ctx) {
 
   if (ctx->pid != 0) return;
 
+  if (!allowed_fds_complete) {
+    LOGE("Not all allowed fds could be recorded, skipping fd sanitization");
+
+    return;
+  }
+
   /* INFO: Close all forbidden fds to prevent crashing */
+  size_t closed_fds = 0;
+
+#ifdef __NR_close_range
+  if (close_range_supported) {
+    /* INFO: Closes every gap between allowed fds, whether open or not, so that the
+               cost depends on how fragmented the allowed fds are, not on a scan.
+               Allowed fds are found a word at a time, skipping empty words. */
+    unsigned int gap_start = 0;
+    for (size_t i = 0; i < ctx->allowed_fds.words_count; i++) {
+      unsigned long word = ctx->allowed_fds.words[i];
+
+      while (word) {
+        unsigned int fd = (unsigned int)(i * FD_BITMAP_WORD_BITS) + (unsigned int)__builtin_ctzl(word);
+        word &= word - 1;
+
+        if (fd > gap_start) {
+          syscall(__NR_close_range, gap_start, fd - 1, 0);
+          closed_fds++;
+        }
+
+        gap_start = fd + 1;
+      }
+    }
+
+    syscall(__NR_close_range, gap_start, ~0U, 0);
+    closed_fds++;
+
+    RZ_TRACE(RZ_TRACE_FDS_SANITIZED, RZ_TRACE_NO_MODULE, closed_fds);
+
+    return;
+  }
+#endif
+
   DIR *dir = opendir("/proc/self/fd");
   if (!dir) {
     PLOGE("Failed to open /proc/self/fd");
@@ -916,14 +1974,17 @@ static void rz_sanitize_fds(struct zygisk_context *ctx) {
   struct dirent *entry;
   while ((entry = readdir(dir))) {
     int fd = parse_int(entry->d_name);
-    if (fd < 0 || fd >= MAX_FD_SIZE || fd == dfd || ctx->allowed_fds[fd]) continue;
+    if (fd < 0 || fd == dfd || fd_bitmap_get(&ctx->allowed_fds, fd)) continue;
 
     close(fd);
+    closed_fds++;
 
     LOGW("Closed leaked fd: %d", fd);
   }
 
   closedir(dir);
+
+  RZ_TRACE(RZ_TRACE_FDS_SANITIZED, RZ_TRACE_NO_MODULE, closed_fds);
 }
 
 static void rz_fork_post(struct zygisk_context *ctx __attribute__((unused))) {
@@ -931,6 +1992,51 @@ static void rz_fork_post(struct zygisk_context *ctx __attribute__((unused))) {
   g_ctx = NULL;
 }
 
+/* INFO: Modules with a targets manifest, which are only loaded in the children of
+           Zygote that they target, instead of in Zygote itself. */
+struct deferred_module {
+  char *lib_path;
+  char *targets;
+  size_t index;
+};
+
+static struct deferred_module *deferred_modules = NULL;
+static size_t deferred_modules_count = 0;
+
+/* INFO: Loads the module into the next free slot of zygisk_modules, which has room
+           for every module ReZygiskd reported. */
+static bool load_module(const char *lib_path, size_t index) {
+  struct rezygisk_module *m = &zygisk_modules[zygisk_module_length];
+
+  if (!csoloader_load(&m->lib, lib_path)) {
+    LOGE("Failed to load module [%s]", lib_path);
+
+    return false;
+  }
+
+  void *entry = csoloader_get_symbol(&m->lib, "zygisk_module_entry");
+  if (!entry) {
+    LOGE("Failed to find entry point in module [%s]", lib_path);
+
+    csoloader_unload(&m->lib);
+
+    return false;
+  }
+
+  m->api.register_module = rezygisk_module_register;
+  m->api.impl = ENCODE_ID((void *)zygisk_module_length);
+  m->zygisk_module_entry = (void (*)(void *, void *))entry;
+  m->index = index;
+
+  LOGD("Loaded module [%s]. Entry: %p", lib_path, entry);
+
+  m->skip = false;
+  m->unload = false;
+  zygisk_module_length++;
+
+  return true;
+}
+
 static bool load_modules_only(void) {
   struct zygisk_modules ms;
   if (!rezygiskd_read_modules(&ms)) {
@@ -940,74 +2046,221 @@ static bool load_modules_only(void) {
   }
 
   zygisk_modules = (struct rezygisk_module *)malloc(ms.modules_count * sizeof(struct rezygisk_module));
-  if (!zygisk_modules) {
+  deferred_modules = (struct deferred_module *)malloc(ms.modules_count * sizeof(struct deferred_module));
+  size_t *failed_modules = (size_t *)malloc(ms.modules_count * sizeof(size_t));
+  if (!zygisk_modules || !deferred_modules || !failed_modules) {
     LOGE("Failed to allocate memory for modules");
 
+    free(zygisk_modules);
+    zygisk_modules = NULL;
+    free(deferred_modules);
+    deferred_modules = NULL;
+    free(failed_modules);
+
     free_modules(&ms);
 
     return false;
   }
 
+  size_t failed_modules_count = 0;
+
+  module_filters_init(ms.modules_count);
+
   for (size_t i = 0; i < ms.modules_count; i++) {
-    const char *lib_path = ms.modules[i];
+    /* INFO: ReZygiskd's list no longer has the modules that failed before this one */
+    size_t index = i - failed_modules_count;
 
-    if (!csoloader_load(&zygisk_modules[zygisk_module_length].lib, lib_path)) {
-      LOGE("Failed to load module [%s]", lib_path);
+    if (ms.targets[i]) {
+      LOGD("Deferring module [%s] to the processes it targets", ms.modules[i]);
 
-      /* INFO: In case a module failed to load, update the list of available modules
-           in ReZygiskd to avoid a mismatch between the loaded modules in ReZygisk
-           Zygote library and the available modules in ReZygiskd. */
-      /* TODO: Update the list of modules for ReZygisk monitor, so that it can update
-                 for WebUI. That is simply cosmetic, though. */
-      rezygiskd_remove_module(i);
+      deferred_modules[deferred_modules_count++] = (struct deferred_module) {
+        .lib_path = ms.modules[i],
+        .targets = ms.targets[i],
+        .index = index
+      };
+
+      ms.modules[i] = NULL;
+      ms.targets[i] = NULL;
 
       continue;
     }
 
-    void *entry = csoloader_get_symbol(&zygisk_modules[zygisk_module_length].lib, "zygisk_module_entry");
-    if (!entry) {
-      LOGE("Failed to find entry point in module [%s]", lib_path);
+    if (!load_module(ms.modules[i], index)) failed_modules[failed_modules_count++] = i;
+  }
 
-      csoloader_unload(&zygisk_modules[zygisk_module_length].lib);
+  /* INFO: In case a module failed to load, update the list of available modules
+             in ReZygiskd to avoid a mismatch between the loaded modules in ReZygisk
+             Zygote library and the available modules in ReZygiskd. All of them are
+             sent at once, as their indices shift with each removal. */
+  /* TODO: Update the list of modules for ReZygisk monitor, so that it can update
+             for WebUI. That is simply cosmetic, though. */
+  if (failed_modules_count > 0 && !rezygiskd_remove_modules(failed_modules, failed_modules_count))
+    LOGE("Failed to remove %zu failed modules from ReZygiskd", failed_modules_count);
 
-      rezygiskd_remove_module(i);
+  free(failed_modules);
+  free_modules(&ms);
 
-      continue;
+  /* INFO: csoloader maps modules without the linker, so the snapshot cannot notice */
+  maps_snapshot_invalidate();
+
+  return true;
+}
+
+static bool module_targets_match(const char *targets, const char *process) {
+  const char *line = targets;
+  while (*line) {
+    const char *line_end = strchrnul(line, '\n');
+
+    char pattern[PATH_MAX];
+    size_t pattern_len = (size_t)(line_end - line);
+    if (pattern_len < sizeof(pattern)) {
+      memcpy(pattern, line, pattern_len);
+      pattern[pattern_len] = '\0';
+
+      if (fnmatch(pattern, process, 0) == 0) return true;
     }
 
-    zygisk_modules[zygisk_module_length].api.register_module = rezygisk_module_register;
-    zygisk_modules[zygisk_module_length].api.impl = ENCODE_ID((void *)zygisk_module_length);
-    zygisk_modules[zygisk_module_length].zygisk_module_entry = (void (*)(void *, void *))entry;
+    if (!*line_end) break;
+
+    line = line_end + 1;
+  }
+
+  return false;
+}
+
+/* INFO: Called in Zygote children, before the modules are run. A module that fails
+           to load here is not removed from ReZygiskd, as that would shift the indices
+           Zygote still holds for the other modules. */
+static void load_deferred_modules(const char *process) {
+  if (deferred_modules_count == 0 || !process) return;
+
+  /* INFO: Relocated in every child that loads them, unlike modules Zygote loaded */
+  bool share_relro = shared_relro_enabled();
 
-    LOGD("Loaded module [%s]. Entry: %p", lib_path, entry);
+  size_t loaded = 0;
+  for (size_t i = 0; i < deferred_modules_count; i++) {
+    struct deferred_module *d = &deferred_modules[i];
+    if (!module_targets_match(d->targets, process) || module_stats_quarantined(d->index)) continue;
 
-    zygisk_modules[zygisk_module_length].unload = false;
-    zygisk_module_length++;
+    if (!load_module(d->lib_path, d->index)) continue;
+
+    loaded++;
+
+    if (share_relro) shared_relro_apply(d->index, (const void *)zygisk_modules[zygisk_module_length - 1].zygisk_module_entry);
   }
 
-  free_modules(&ms);
+  if (loaded > 0) maps_snapshot_invalidate();
+}
 
-  return true;
+static void deferred_modules_free(void) {
+  for (size_t i = 0; i < deferred_modules_count; i++) {
+    free(deferred_modules[i].lib_path);
+    free(deferred_modules[i].targets);
+  }
+
+  free(deferred_modules);
+  deferred_modules = NULL;
+  deferred_modules_count = 0;
+}
+
+/* INFO: Traces the PSS and private dirty memory of libzygisk and of every module
+           still mapped. Modules are told apart by the mappings of their file, so
+           their heap allocations, like those of ReZygisk, are not included. */
+static void rz_sample_memory(enum rz_trace_mem_point point) {
+  if (!RZ_TRACE_MEMORY_ENABLED()) return;
+
+  struct mem_stats_owner *owners = (struct mem_stats_owner *)calloc(zygisk_module_length + 1, sizeof(struct mem_stats_owner));
+  if (!owners) {
+    PLOGE("allocating memory sample owners");
+
+    return;
+  }
+
+  owners[0].module = RZ_TRACE_NO_MODULE;
+  owners[0].start = (uintptr_t)start_addr;
+  owners[0].end = (uintptr_t)start_addr + block_size;
+
+  size_t owners_count = 1;
+  for (size_t i = 0; i < zygisk_module_length; i++) {
+    struct rezygisk_module *m = &zygisk_modules[i];
+
+    /* INFO: Unloaded once their post callbacks ran */
+    if (point >= RZ_TRACE_MEM_AFTER_MODULES_UNLOAD && m->unload) continue;
+
+    owners[owners_count].module = (uint16_t)m->index;
+    if (mem_stats_module_range((const void *)m->zygisk_module_entry, &owners[owners_count])) owners_count++;
+  }
+
+  if (mem_stats_collect(owners, owners_count)) {
+    RZ_TRACE(RZ_TRACE_MEM_SAMPLE, RZ_TRACE_NO_MODULE, point);
+
+    for (size_t i = 0; i < owners_count; i++) {
+      RZ_TRACE(RZ_TRACE_MEM_PSS, owners[i].module, owners[i].pss_kb);
+      RZ_TRACE(RZ_TRACE_MEM_PRIVATE_DIRTY, owners[i].module, owners[i].private_dirty_kb);
+    }
+  }
+
+  free(owners);
 }
 
 static void rz_run_modules_pre(struct zygisk_context *ctx) {
+  rz_sample_memory(RZ_TRACE_MEM_BEFORE_SPECIALIZE);
+
+  RZ_TRACE(RZ_TRACE_MODULES_PRE_START, RZ_TRACE_NO_MODULE, zygisk_module_length);
+
+  struct module_filter_target target;
+  module_filter_target_get(ctx, &target);
+
   for (size_t i = 0; i < zygisk_module_length; i++) {
-    rz_module_call_on_load(&zygisk_modules[i], ctx->env);
+    struct rezygisk_module *m = &zygisk_modules[i];
+
+    /* INFO: Never ran in this process, so it can be unloaded safely */
+    if (module_stats_quarantined(m->index) || !module_filter_allows(m->index, &target)) {
+      m->skip = true;
+      m->unload = true;
+
+      continue;
+    }
 
-    if (FLAG_GET(ctx, APP_SPECIALIZE)) rz_module_call_pre_app_specialize(&zygisk_modules[i], ctx->args.app);
-    else if (FLAG_GET(ctx, SERVER_FORK_AND_SPECIALIZE)) rz_module_call_pre_server_specialize(&zygisk_modules[i], ctx->args.server);
+    uint64_t start_us = module_stats_begin(m->index);
+    rz_module_call_on_load(m, ctx->env);
+    module_stats_record(m->index, MODULE_STATS_ON_LOAD, start_us);
+
+    /* INFO: The filter may have just been set in onLoad */
+    if (!module_filter_allows(m->index, &target)) {
+      m->skip = true;
+
+      continue;
+    }
+
+    start_us = module_stats_begin(m->index);
+    if (FLAG_GET(ctx, APP_SPECIALIZE)) rz_module_call_pre_app_specialize(m, ctx->args.app);
+    else if (FLAG_GET(ctx, SERVER_FORK_AND_SPECIALIZE)) rz_module_call_pre_server_specialize(m, ctx->args.server);
+    module_stats_record(m->index, MODULE_STATS_PRE, start_us);
+
+    RZ_TRACE(RZ_TRACE_MODULE_PRE_DONE, (uint16_t)i, 0);
   }
 }
 
 static void rz_run_modules_post(struct zygisk_context *ctx) {
   FLAG_SET(ctx, POST_SPECIALIZE);
 
+  rz_sample_memory(RZ_TRACE_MEM_AFTER_SPECIALIZE);
+
+  RZ_TRACE(RZ_TRACE_MODULES_POST_START, RZ_TRACE_NO_MODULE, zygisk_module_length);
+
   size_t modules_unloaded = 0;
   for (size_t i = 0; i < zygisk_module_length; i++) {
     struct rezygisk_module *m = &zygisk_modules[i];
 
-    if (FLAG_GET(ctx, APP_SPECIALIZE)) rz_module_call_post_app_specialize(m, ctx->args.app);
-    else if (FLAG_GET(ctx, SERVER_FORK_AND_SPECIALIZE)) rz_module_call_post_server_specialize(m, ctx->args.server);
+    if (!m->skip) {
+      uint64_t start_us = module_stats_begin(m->index);
+      if (FLAG_GET(ctx, APP_SPECIALIZE)) rz_module_call_post_app_specialize(m, ctx->args.app);
+      else if (FLAG_GET(ctx, SERVER_FORK_AND_SPECIALIZE)) rz_module_call_post_server_specialize(m, ctx->args.server);
+      module_stats_record(m->index, MODULE_STATS_POST, start_us);
+    }
+
+    RZ_TRACE(RZ_TRACE_MODULE_POST_DONE, (uint16_t)i, 0);
 
     if (!m->unload) {
       LOGD("Abandoning module library at %p", &m->lib);
@@ -1026,54 +2279,34 @@ static void rz_run_modules_post(struct zygisk_context *ctx) {
     modules_unloaded++;
   }
 
+  if (modules_unloaded > 0) maps_snapshot_invalidate();
+
+  rz_sample_memory(RZ_TRACE_MEM_AFTER_MODULES_UNLOAD);
+
   if (zygisk_module_length > 0)
     LOGD("Modules unloaded: %zu/%zu", modules_unloaded, zygisk_module_length);
+
+  RZ_TRACE(RZ_TRACE_MODULES_UNLOADED, RZ_TRACE_NO_MODULE, modules_unloaded);
 }
 
 static void rz_app_specialize_pre(struct zygisk_context *ctx) {
   FLAG_SET(ctx, APP_SPECIALIZE);
 
-  /* INFO: Isolated services have different UIDs than the main apps. Because
-              numerous root implementations base themselves in the UID of the
-              app, we need to ensure that the UID sent to ReZygiskd to search
-              is the app's and not the isolated service, or else it will be
-              able to bypass DenyList.
+  /* INFO: Before any mount namespace switch, in the same namespace Zygote loads from */
+  load_deferred_modules(ctx->process);
 
-           All apps, and isolated processes, of *third-party* applications will
-             have their app_data_dir set. The system applications might not have
-             one, however it is unlikely they will create an isolated process,
-             and even if so, it should not impact in detections, performance or
-             any area.
-  */
-  uid_t uid = *ctx->args.app->uid;
-  if (IS_ISOLATED_SERVICE(uid) && ctx->args.app->app_data_dir) {
-    /* INFO: If the app is an isolated service, we use the UID of the
-               app's process data directory, which is the UID of the
-               app itself, which root implementations actually use.
-    */
-    const char *data_dir = (*ctx->env)->GetStringUTFChars(ctx->env, *ctx->args.app->app_data_dir, NULL);
-    if (!data_dir) {
-      LOGE("Failed to get app data directory");
-
-      return;
-    }
-
-    struct stat st;
-    if (stat(data_dir, &st) == -1) {
-      PLOGE("Failed to stat app data directory [%s]", data_dir);
-
-      (*ctx->env)->ReleaseStringUTFChars(ctx->env, *ctx->args.app->app_data_dir, data_dir);
-
-      return;
-    }
-
-    uid = st.st_uid;
-    LOGD("Isolated service being related to UID %d, app data dir: %s", uid, data_dir);
+  if (ctx->info_flags_fd != -1) {
+    ctx->info_flags = rezygiskd_read_process_flags(ctx->info_flags_fd);
+    ctx->info_flags_fd = -1;
+  } else {
+    uid_t uid;
+    if (!rz_get_flags_uid(ctx, &uid)) return;
 
-    (*ctx->env)->ReleaseStringUTFChars(ctx->env, *ctx->args.app->app_data_dir, data_dir);
+    RZ_TRACE(RZ_TRACE_FLAGS_QUERY_SENT, RZ_TRACE_NO_MODULE, uid);
+    ctx->info_flags = rezygiskd_get_process_flags(uid, ctx->process);
   }
 
-  ctx->info_flags = rezygiskd_get_process_flags(uid, ctx->process);
+  RZ_TRACE(RZ_TRACE_FLAGS_QUERY_RECEIVED, RZ_TRACE_NO_MODULE, ctx->info_flags);
   /* INFO: To ensure we are really using a clean mount namespace, we use
               the first process it as reference for clean mount namespace,
               before it even does something, so that it will be clean yet
@@ -1170,6 +2403,8 @@ static void rz_nativeForkSystemServer_pre(struct zygisk_context *ctx) {
   rz_fork_pre(ctx);
   if (!is_zygote_child(ctx)) return;
 
+  load_deferred_modules("system_server");
+
   rz_run_modules_pre(ctx);
 
   rz_sanitize_fds(ctx);
@@ -1212,6 +2447,7 @@ static void rz_init(struct zygisk_context *ctx, JNIEnv *env, void *args) {
   ctx->env = env;
   ctx->args.ptr = args;
   ctx->pid = -1;
+  ctx->info_flags_fd = -1;
   pthread_mutex_init(&ctx->hook_info_lock, NULL);
 
   g_ctx = ctx;
@@ -1220,14 +2456,28 @@ static void rz_init(struct zygisk_context *ctx, JNIEnv *env, void *args) {
 static void rz_cleanup(struct zygisk_context *ctx) {
   g_ctx = NULL;
 
+  free(ctx->exempted_fds);
+  ctx->exempted_fds = NULL;
+  ctx->exempted_fds_count = 0;
+
+  maps_snapshot_invalidate();
+  parse_maps_self_close();
+
   if (!is_zygote_child(ctx)) return;
 
+  fd_path_cache_unmap();
+  module_filters_unmap();
+  module_stats_detach();
+  deferred_modules_free();
+
   should_unmap_zygisk = true;
 
+  uint64_t cleanup_start_us = now_us();
+
   /* INFO: Unhook JNI methods */
   for (size_t i = 0; i < jni_hook_list_count; i++) {
     struct jni_hook_entry *entry = &jni_hook_list[i];
-    jclass jc = (*ctx->env)->FindClass(ctx->env, entry->class_name);
+    jclass jc = entry->clazz ? entry->clazz : (*ctx->env)->FindClass(ctx->env, entry->class_name);
     if (jc) {
       if (entry->methods_count > 0 && (*ctx->env)->RegisterNatives(ctx->env, jc, entry->methods, (jint)entry->methods_count) != 0) {
         LOGE("Failed to restore JNI hook of class [%s]", entry->class_name);
@@ -1235,7 +2485,10 @@ static void rz_cleanup(struct zygisk_context *ctx) {
         should_unmap_zygisk = false;
       }
 
-      (*ctx->env)->DeleteLocalRef(ctx->env, jc);
+      if (entry->clazz) (*ctx->env)->DeleteGlobalRef(ctx->env, jc);
+      else (*ctx->env)->DeleteLocalRef(ctx->env, jc);
+    } else {
+      (*ctx->env)->ExceptionClear(ctx->env);
     }
 
     free(entry->class_name);
@@ -1246,52 +2499,46 @@ static void rz_cleanup(struct zygisk_context *ctx) {
   jni_hook_list = NULL;
   jni_hook_list_count = 0;
 
+  jni_cache_clear(ctx->env);
+
   for (size_t i = 0; i < ctx->register_info_count; i++) {
-    regfree(&ctx->register_info[i].regex);
+    plt_matcher_free(&ctx->register_info[i].matcher);
     free(ctx->register_info[i].symbol);
   }
   ctx->register_info_count = 0;
 
   for (size_t i = 0; i < ctx->ignore_info_count; i++) {
-    regfree(&ctx->ignore_info[i].regex);
+    plt_matcher_free(&ctx->ignore_info[i].matcher);
     free(ctx->ignore_info[i].symbol);
   }
   ctx->ignore_info_count = 0;
 
-  if (plt_hook_list) {
-    for (size_t i = 0; i < plt_hook_list_count; i++) {
-      free((void *)plt_hook_list[i].lib_path);
-      free((void *)plt_hook_list[i].symbol);
-    }
+  plt_matcher_cache_clear();
 
-    free(plt_hook_list);
-    plt_hook_list = NULL;
-    plt_hook_list_count = 0;
-  }
+  plt_hook_list_clear();
 
   /* INFO: Strip out all API function pointers */
   for (size_t i = 0; i < zygisk_module_length; i++) {
     memset(&zygisk_modules[i], 0, sizeof(zygisk_modules[i]));
   }
 
-  enable_unloader = true;
-  pthread_mutex_destroy(&ctx->hook_info_lock);
-}
-
-/* INFO: PLT hook commit helper */
+  /* INFO: Armed only now, in the child, so that Zygote never runs this trampoline
+             on its own thread creations. */
+  if (!oneshot_hook_arm(&pthread_attr_setstacksize_oneshot)) {
+    LOGE("Failed to arm the unloader hook, libzygisk.so will stay mapped");
 
-static bool hook_register(const char *lib_name, const char *symbol, bool is_prefix, void *new_func, void **backup) {
-  if (!(is_prefix ? plti_add_hook_by_prefix : plti_add_hook)(&plti_ctx, lib_name, symbol, new_func, backup)) {
-    LOGE("Failed to register plt_hook \"%s\" with PLTI", symbol);
-
-    return false;
+    /* INFO: The hook would have detached it, and it will never run */
+    rz_trace_detach();
   }
 
-  LOGD("Registered plt_hook for symbol \"%s\" in library \"%s\"", symbol, lib_name);
+  enable_unloader = true;
+  pthread_mutex_destroy(&ctx->hook_info_lock);
 
-  return true;
+  LOGD("Cleanup took %" PRIu64 " us", now_us() - cleanup_start_us);
 }
 
+/* INFO: PLT hook commit helper */
+
 static bool hook_unregister(const char *lib_name, const char *symbol, bool is_prefix, void **backup) {
   if (!(is_prefix ? plti_remove_hook_by_prefix : plti_remove_hook)(&plti_ctx, lib_name, symbol, backup)) {
     LOGE("Failed to unregister plt_hook \"%s\" with PLTI", symbol);
@@ -1324,8 +2571,8 @@ void hook_functions(void) {
   plti_add_lib(&plti_ctx, "libandroid_runtime.so");
 
   PLT_HOOK_REGISTER("libandroid_runtime.so", fork, false);
-  PLT_HOOK_REGISTER("libandroid_runtime.so", strdup, false);
-  PLT_HOOK_REGISTER("libandroid_runtime.so", property_get, false);
+  oneshot_hook_arm(&strdup_oneshot);
+  oneshot_hook_arm(&property_get_oneshot);
   PLT_HOOK_REGISTER_SYM("libandroid_runtime.so", "_ZNK18FileDescriptorInfo14ReopenOrDetach", _ZNK18FileDescriptorInfo14ReopenOrDetach, true);
 }
 
@@ -1336,21 +2583,40 @@ static void hook_unloader(void) {
     return;
   }
 
-  PLT_HOOK_REGISTER("libart.so", pthread_attr_setstacksize, false);
-
-  PLT_HOOK_UNREGISTER("libandroid_runtime.so", property_get, false);
+  /* INFO: libart.so is loaded by now, so this hook has served its purpose. The
+             pthread_attr_setstacksize hook is only armed in children, at cleanup. */
+  oneshot_hook_retire(&property_get_oneshot);
 
   /* INFO: Load modules early on (before system server fork) to spread through all Zygotes */
   if (!load_modules_only()) {
     LOGE("Failed to load modules in hook_unloader");
   }
 
+  fd_path_cache_init();
+
+  /* INFO: Mapped once here, so that every Zygote child inherits the shared mapping
+             and can trace without talking to ReZygiskd. */
+  int trace_fd = rezygiskd_get_trace_buffer();
+  if (trace_fd != -1) {
+    if (!rz_trace_attach(trace_fd, true)) LOGE("Failed to attach to the trace buffer");
+
+    close(trace_fd);
+  }
+
+  /* INFO: Same for the module timings, which children add to as they run the modules */
+  int module_stats_fd = rezygiskd_get_module_stats_buffer();
+  if (module_stats_fd != -1) {
+    if (!module_stats_attach(module_stats_fd)) LOGE("Failed to attach to the module stats buffer");
+
+    close(module_stats_fd);
+  }
+
   LOGD("ReZygisk unloader hooked successfully");
 }
 
 static void unhook_functions(void) {
   PLT_HOOK_UNREGISTER("libandroid_runtime.so", fork, false);
-  PLT_HOOK_UNREGISTER("libandroid_runtime.so", strdup, false);
+  oneshot_hook_retire(&strdup_oneshot);
   PLT_HOOK_UNREGISTER_SYM("libandroid_runtime.so", "_ZNK18FileDescriptorInfo14ReopenOrDetach", _ZNK18FileDescriptorInfo14ReopenOrDetach, true);
-  PLT_HOOK_UNREGISTER("libart.so", pthread_attr_setstacksize, false);
+  oneshot_hook_retire(&pthread_attr_setstacksize_oneshot);
 }
@@ -0,0 +1,232 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <link.h>
+#include <unistd.h>
+
+#include "logging.h"
+#include "misc.h"
+
+#include "maps_snapshot.h"
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+struct maps_generation {
+  bool valid;
+  unsigned long long adds;
+  unsigned long long subs;
+};
+
+static struct maps_snapshot snapshot = { 0 };
+static bool snapshot_built = false;
+static pid_t snapshot_pid = 0;
+static struct maps_generation snapshot_generation = { 0 };
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t len) {
+  const uint8_t *bytes = (const uint8_t *)data;
+
+  for (size_t i = 0; i < len; i++) {
+    hash ^= bytes[i];
+    hash *= FNV_PRIME;
+  }
+
+  return hash;
+}
+
+static uint64_t hash_inode(dev_t dev, ino_t inode) {
+  uint64_t key[] = { (uint64_t)dev, (uint64_t)inode };
+
+  return hash_bytes(FNV_OFFSET_BASIS, key, sizeof(key));
+}
+
+static size_t table_size_for(size_t count) {
+  size_t size = 16;
+  while (size < count * 2) size *= 2;
+
+  return size;
+}
+
+static int read_generation(struct dl_phdr_info *info, size_t size, void *data) {
+  struct maps_generation *generation = (struct maps_generation *)data;
+
+  /* INFO: dlpi_adds and dlpi_subs are only present on newer linkers */
+  if (size < offsetof(struct dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs)) return 1;
+
+  generation->valid = true;
+  generation->adds = info->dlpi_adds;
+  generation->subs = info->dlpi_subs;
+
+  /* INFO: The counters are the same for every library, so one is enough */
+  return 1;
+}
+
+static struct maps_generation current_generation(void) {
+  struct maps_generation generation = { 0 };
+  dl_iterate_phdr(read_generation, &generation);
+
+  return generation;
+}
+
+/* INFO: Makes entries with the same path share one string, freeing the duplicates */
+static bool intern_paths(void) {
+  size_t table_size = table_size_for(snapshot.length);
+  uint32_t *table = calloc(table_size, sizeof(uint32_t));
+  snapshot.paths = malloc(snapshot.length * sizeof(char *));
+  snapshot.path_ids = malloc(snapshot.length * sizeof(uint32_t));
+  if (!table || !snapshot.paths || !snapshot.path_ids) {
+    LOGE("Failed to allocate memory for maps path table");
+
+    free(table);
+    free(snapshot.paths);
+    snapshot.paths = NULL;
+
+    return false;
+  }
+
+  for (size_t i = 0; i < snapshot.length; i++) {
+    char *path = snapshot.maps[i].path;
+    size_t slot = (size_t)hash_bytes(FNV_OFFSET_BASIS, path, strlen(path)) & (table_size - 1);
+
+    /* INFO: Slots hold path index + 1, 0 being empty */
+    while (table[slot] && strcmp(snapshot.paths[table[slot] - 1], path) != 0) {
+      slot = (slot + 1) & (table_size - 1);
+    }
+
+    if (table[slot]) {
+      free(path);
+      snapshot.maps[i].path = snapshot.paths[table[slot] - 1];
+      snapshot.path_ids[i] = table[slot] - 1;
+
+      continue;
+    }
+
+    snapshot.path_ids[i] = (uint32_t)snapshot.paths_count;
+    snapshot.paths[snapshot.paths_count++] = path;
+    table[slot] = (uint32_t)snapshot.paths_count;
+  }
+
+  free(table);
+
+  return true;
+}
+
+static bool index_inodes(void) {
+  snapshot.inode_index_size = table_size_for(snapshot.length);
+  snapshot.inode_index = calloc(snapshot.inode_index_size, sizeof(uint32_t));
+  if (!snapshot.inode_index) {
+    LOGE("Failed to allocate memory for maps inode index");
+
+    return false;
+  }
+
+  for (size_t i = 0; i < snapshot.length; i++) {
+    struct map_entry *entry = &snapshot.maps[i];
+    if (entry->inode == 0) continue;
+
+    size_t slot = (size_t)hash_inode(entry->dev, entry->inode) & (snapshot.inode_index_size - 1);
+
+    /* INFO: Entries are sorted by address, so the first one kept is the lowest */
+    bool found = false;
+    while (snapshot.inode_index[slot]) {
+      struct map_entry *other = &snapshot.maps[snapshot.inode_index[slot] - 1];
+      if (other->dev == entry->dev && other->inode == entry->inode) {
+        found = true;
+
+        break;
+      }
+
+      slot = (slot + 1) & (snapshot.inode_index_size - 1);
+    }
+
+    if (!found) snapshot.inode_index[slot] = (uint32_t)(i + 1);
+  }
+
+  return true;
+}
+
+void maps_snapshot_invalidate(void) {
+  if (!snapshot_built) return;
+
+  /* INFO: Paths are interned, so they are freed from the path table, not per entry */
+  if (snapshot.paths) {
+    for (size_t i = 0; i < snapshot.paths_count; i++) {
+      free(snapshot.paths[i]);
+    }
+  } else {
+    for (size_t i = 0; i < snapshot.length; i++) {
+      free(snapshot.maps[i].path);
+    }
+  }
+
+  free(snapshot.paths);
+  free(snapshot.path_ids);
+  free(snapshot.maps);
+  free(snapshot.inode_index);
+
+  memset(&snapshot, 0, sizeof(snapshot));
+  snapshot_built = false;
+}
+
+const struct maps_snapshot *maps_snapshot_get(void) {
+  struct maps_generation generation = current_generation();
+
+  /* INFO: After a fork the snapshot describes the parent, and without the linker
+             counters there is no way to tell whether it is still accurate. */
+  if (snapshot_built && snapshot_pid == getpid() && generation.valid &&
+      generation.adds == snapshot_generation.adds && generation.subs == snapshot_generation.subs)
+    return &snapshot;
+
+  maps_snapshot_invalidate();
+
+  struct maps_info *maps = parse_maps_self();
+  if (!maps) return NULL;
+
+  snapshot.maps = maps->maps;
+  snapshot.length = maps->length;
+  snapshot_built = true;
+  free(maps);
+
+  if (snapshot.length > UINT32_MAX - 1 || !intern_paths() || !index_inodes()) {
+    maps_snapshot_invalidate();
+
+    return NULL;
+  }
+
+  snapshot_pid = getpid();
+  snapshot_generation = generation;
+
+  return &snapshot;
+}
+
+const struct map_entry *maps_snapshot_find_inode(const struct maps_snapshot *snapshot, dev_t dev, ino_t inode) {
+  if (snapshot->inode_index_size == 0) return NULL;
+
+  size_t slot = (size_t)hash_inode(dev, inode) & (snapshot->inode_index_size - 1);
+  while (snapshot->inode_index[slot]) {
+    const struct map_entry *entry = &snapshot->maps[snapshot->inode_index[slot] - 1];
+    if (entry->dev == dev && entry->inode == inode) return entry;
+
+    slot = (slot + 1) & (snapshot->inode_index_size - 1);
+  }
+
+  return NULL;
+}
+
+const struct map_entry *maps_snapshot_find_addr(const struct maps_snapshot *snapshot, uintptr_t addr) {
+  size_t low = 0;
+  size_t high = snapshot->length;
+
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    const struct map_entry *entry = &snapshot->maps[mid];
+
+    if (addr < entry->start) high = mid;
+    else if (addr >= entry->end) low = mid + 1;
+    else return entry;
+  }
+
+  return NULL;
+}
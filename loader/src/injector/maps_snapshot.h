@@ -0,0 +1,40 @@
+#ifndef MAPS_SNAPSHOT_H
+#define MAPS_SNAPSHOT_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "misc.h"
+
+/* INFO: Process-wide copy of our own memory maps. Entries are sorted by address,
+           and entries of the same file share one interned path string. */
+struct maps_snapshot {
+  struct map_entry *maps;
+  size_t length;
+
+  char **paths;
+  size_t paths_count;
+  /* INFO: Index in "paths" of the path of each entry */
+  uint32_t *path_ids;
+
+  /* INFO: Open addressing (dev, inode) -> entry index + 1, 0 being empty */
+  uint32_t *inode_index;
+  size_t inode_index_size;
+};
+
+/* INFO: Returns the cached snapshot, rebuilding it if the loaded libraries changed
+           since it was taken. It, and the entries found in it, are only valid
+           until the next call to any maps_snapshot function. Not thread-safe. */
+const struct maps_snapshot *maps_snapshot_get(void);
+
+/* INFO: Lowest mapping of the file with the given (dev, inode), or NULL */
+const struct map_entry *maps_snapshot_find_inode(const struct maps_snapshot *snapshot, dev_t dev, ino_t inode);
+
+/* INFO: Mapping containing "addr", or NULL */
+const struct map_entry *maps_snapshot_find_addr(const struct maps_snapshot *snapshot, uintptr_t addr);
+
+/* INFO: Frees the snapshot. Needed after mappings not made through the linker,
+           which the generation check cannot see. */
+void maps_snapshot_invalidate(void);
+
+#endif /* MAPS_SNAPSHOT_H */
@@ -0,0 +1,91 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logging.h"
+
+#include "maps_snapshot.h"
+#include "mem_stats.h"
+#include "misc.h"
+
+bool mem_stats_module_range(const void *addr, struct mem_stats_owner *owner) {
+  const struct maps_snapshot *snapshot = maps_snapshot_get();
+  if (!snapshot) return false;
+
+  const struct map_entry *entry = maps_snapshot_find_addr(snapshot, (uintptr_t)addr);
+  if (!entry || entry->inode == 0) return false;
+
+  const struct map_entry *first = maps_snapshot_find_inode(snapshot, entry->dev, entry->inode);
+  if (!first) return false;
+
+  owner->start = first->start;
+  owner->end = first->end;
+
+  /* INFO: Entries are sorted by address, and csoloader maps an image contiguously */
+  for (size_t i = (size_t)(first - snapshot->maps) + 1; i < snapshot->length; i++) {
+    const struct map_entry *next = &snapshot->maps[i];
+    if (next->start != owner->end) break;
+
+    bool same_file = next->dev == entry->dev && next->inode == entry->inode;
+    bool anonymous = next->inode == 0 && (next->path[0] == '\0' || strncmp(next->path, "[anon:", strlen("[anon:")) == 0);
+    if (!same_file && !anonymous) break;
+
+    owner->end = next->end;
+
+    /* INFO: Only the bss follows the last segment of the file */
+    if (anonymous) break;
+  }
+
+  return true;
+}
+
+/* INFO: smaps has some 20 lines per mapping, so it is several times the size of maps */
+static size_t smaps_capacity = 1024 * 1024;
+
+bool mem_stats_collect(struct mem_stats_owner *owners, size_t owners_count) {
+  /* INFO: Read through the same helper as the maps, as this runs in the app too */
+  size_t smaps_len;
+  char *smaps = read_self_proc_file("/proc/self/smaps", &smaps_capacity, &smaps_len);
+  if (!smaps) return false;
+
+  for (size_t i = 0; i < owners_count; i++) {
+    owners[i].pss_kb = 0;
+    owners[i].private_dirty_kb = 0;
+  }
+
+  struct mem_stats_owner *current = NULL;
+
+  char *line = smaps;
+  while (*line) {
+    char *line_end = strchr(line, '\n');
+    if (line_end) *line_end = '\0';
+
+    uintptr_t start, end;
+    unsigned long long value_kb;
+
+    /* INFO: Mapping headers are the only lines starting with a hexadecimal range */
+    if (sscanf(line, "%" SCNxPTR "-%" SCNxPTR " ", &start, &end) == 2) {
+      current = NULL;
+
+      for (size_t i = 0; i < owners_count; i++) {
+        if (start >= owners[i].start && start < owners[i].end) {
+          current = &owners[i];
+
+          break;
+        }
+      }
+    } else if (current) {
+      if (sscanf(line, "Pss: %llu kB", &value_kb) == 1) current->pss_kb += value_kb;
+      else if (sscanf(line, "Private_Dirty: %llu kB", &value_kb) == 1) current->private_dirty_kb += value_kb;
+    }
+
+    if (!line_end) break;
+
+    line = line_end + 1;
+  }
+
+  free(smaps);
+
+  return true;
+}
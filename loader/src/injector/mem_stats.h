@@ -0,0 +1,26 @@
+#ifndef MEM_STATS_H
+#define MEM_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* INFO: Memory of an address range, as accounted by /proc/self/smaps */
+struct mem_stats_owner {
+  uint16_t module;
+  uintptr_t start;
+  uintptr_t end;
+
+  uint64_t pss_kb;
+  uint64_t private_dirty_kb;
+};
+
+/* INFO: Sets the range of the module mapped by csoloader that contains "addr": every
+           mapping of its file, and the anonymous ones right after them, its bss. */
+bool mem_stats_module_range(const void *addr, struct mem_stats_owner *owner);
+
+/* INFO: Walks /proc/self/smaps once, adding each mapping to the owner whose range
+           contains it. Expensive, only meant for instrumentation. */
+bool mem_stats_collect(struct mem_stats_owner *owners, size_t owners_count);
+
+#endif /* MEM_STATS_H */
@@ -9,7 +9,7 @@
 
 #include "logging.h"
 
-#define REZYGISK_API_VERSION 5
+#define REZYGISK_API_VERSION 6
 
 enum rezygiskd_flags : uint32_t {
   PROCESS_GRANTED_ROOT = (1u << 0),
@@ -117,6 +117,34 @@ enum rezygisk_options {
   DLCLOSE_MODULE_LIBRARY = 1
 };
 
+/* INFO: Which processes a module runs in, declared through set_process_filter (v6).
+           In processes the filter does not match, neither the module's onLoad nor
+           its specialize functions are called, from the spawn after it is set on.
+           Only the first filter a module sets is kept. */
+enum rezygisk_filter_flags : uint32_t {
+  /* INFO: App processes, restricted by uid_ranges and process_prefixes when given */
+  FILTER_APPS = (1u << 0),
+  FILTER_SYSTEM_SERVER = (1u << 1),
+  /* INFO: Only app processes granted root */
+  FILTER_ROOT_GRANTED_ONLY = (1u << 2)
+};
+
+/* INFO: Inclusive, in app ids: the uid without its user part (uid % 100000) */
+struct rezygisk_uid_range {
+  uid_t first;
+  uid_t last;
+};
+
+struct rezygisk_process_filter {
+  uint32_t flags;
+
+  const struct rezygisk_uid_range *uid_ranges;
+  size_t uid_ranges_count;
+
+  const char *const *process_prefixes;
+  size_t process_prefixes_count;
+};
+
 struct rezygisk_abi {
   long api_version;
   void *impl;
@@ -146,6 +174,7 @@ struct rezygisk_api {
   void (*set_option)(void *, enum rezygisk_options opt);
   int (*get_module_dir)(void *);
   uint32_t (*get_flags)();
+  bool (*set_process_filter)(void *, const struct rezygisk_process_filter *); /* INFO: v6 */
 };
 
 struct rezygisk_module {
@@ -155,6 +184,12 @@ struct rezygisk_module {
   struct csoloader lib;
   void (*zygisk_module_entry)(void *, void *);
 
+  /* INFO: Position in ReZygiskd's list, which differs from the one in zygisk_modules
+             once a module is only loaded in the processes it targets. */
+  size_t index;
+
+  /* INFO: Its filter does not match the current process */
+  bool skip;
   bool unload;
 };
 
@@ -217,7 +252,8 @@ static inline void rz_module_call_pre_app_specialize(struct rezygisk_module *m,
 
       break;
     }
-    case 5: {
+    case 5:
+    case 6: {
       m->abi.pre_app_specialize(m->abi.impl, args);
 
       break;
@@ -268,7 +304,8 @@ static inline void rz_module_call_post_app_specialize(struct rezygisk_module *m,
 
       break;
     }
-    case 5: {
+    case 5:
+    case 6: {
       m->abi.post_app_specialize(m->abi.impl, args);
 
       break;
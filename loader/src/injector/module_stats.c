@@ -0,0 +1,146 @@
+#include <inttypes.h>
+#include <time.h>
+
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "logging.h"
+
+#include "module_stats.h"
+
+static struct module_stats_buffer *module_stats = NULL;
+static size_t module_stats_size = 0;
+
+/* INFO: The call slot held by the callback running in this process, if any */
+static int module_stats_call = -1;
+
+static size_t module_stats_entry_size(uint32_t buckets_count) {
+  return sizeof(struct module_stats_entry) + buckets_count * sizeof(uint32_t);
+}
+
+static size_t module_stats_module_size(uint32_t buckets_count) {
+  return sizeof(struct module_stats_module) + MODULE_STATS_PHASES_COUNT * module_stats_entry_size(buckets_count);
+}
+
+static struct module_stats_module *module_stats_module_get(size_t module) {
+  return (struct module_stats_module *)(module_stats->modules + module * module_stats_module_size(module_stats->buckets_count));
+}
+
+bool module_stats_attach(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    PLOGE("fstat module stats buffer");
+
+    return false;
+  }
+
+  if ((size_t)st.st_size < sizeof(struct module_stats_buffer)) {
+    LOGE("Module stats buffer is too small: %lld", (long long)st.st_size);
+
+    return false;
+  }
+
+  struct module_stats_buffer *buffer = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (buffer == MAP_FAILED) {
+    PLOGE("mmap module stats buffer");
+
+    return false;
+  }
+
+  if (buffer->magic != MODULE_STATS_MAGIC || buffer->version != MODULE_STATS_VERSION || buffer->buckets_count == 0 ||
+      sizeof(struct module_stats_buffer) + buffer->modules_count * module_stats_module_size(buffer->buckets_count) > (size_t)st.st_size) {
+    LOGE("Invalid module stats buffer");
+
+    munmap(buffer, (size_t)st.st_size);
+
+    return false;
+  }
+
+  module_stats = buffer;
+  module_stats_size = (size_t)st.st_size;
+
+  return true;
+}
+
+void module_stats_detach(void) {
+  if (!module_stats) return;
+
+  munmap(module_stats, module_stats_size);
+  module_stats = NULL;
+  module_stats_size = 0;
+}
+
+static uint64_t now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+uint64_t module_stats_begin(size_t module) {
+  if (!module_stats || module >= module_stats->modules_count) return 0;
+
+  /* INFO: Callbacks run one at a time, so a process holds at most one slot. With
+             all of them taken by other children, the callback is just not tracked. */
+  int32_t pid = (int32_t)getpid();
+  for (size_t i = 0; i < MODULE_STATS_CALLS_COUNT; i++) {
+    struct module_stats_call *call = &module_stats->calls[i];
+
+    int32_t free_pid = 0;
+    if (!__atomic_compare_exchange_n(&call->pid, &free_pid, pid, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) continue;
+
+    __atomic_store_n(&call->module, (uint32_t)module, __ATOMIC_RELEASE);
+    module_stats_call = (int)i;
+
+    break;
+  }
+
+  return now_us();
+}
+
+static void module_stats_call_end(void) {
+  if (module_stats_call == -1) return;
+
+  struct module_stats_call *call = &module_stats->calls[module_stats_call];
+
+  __atomic_store_n(&call->module, UINT32_MAX, __ATOMIC_RELAXED);
+  __atomic_store_n(&call->pid, 0, __ATOMIC_RELEASE);
+  module_stats_call = -1;
+}
+
+void module_stats_record(size_t module, enum module_stats_phase phase, uint64_t start_us) {
+  if (!module_stats || module >= module_stats->modules_count) return;
+
+  uint64_t elapsed_us = now_us() - start_us;
+
+  module_stats_call_end();
+
+  struct module_stats_module *shared = module_stats_module_get(module);
+  struct module_stats_entry *entry = (struct module_stats_entry *)(shared->phases + phase * module_stats_entry_size(module_stats->buckets_count));
+
+  if (module_stats->budget_us != 0 && elapsed_us > module_stats->budget_us) {
+    LOGW("Module %zu took %" PRIu64 " us in a callback, over the %u us budget", module, elapsed_us, module_stats->budget_us);
+
+    __atomic_add_fetch(&shared->over_budget, 1, __ATOMIC_RELAXED);
+  }
+
+  /* INFO: Same buckets as ReZygiskd's own stats: 0 under 1us, then log2 of the time */
+  uint32_t bucket = 0;
+  while (bucket < module_stats->buckets_count - 1 && (elapsed_us >> bucket) != 0) bucket++;
+
+  /* INFO: Every Zygote child writes here concurrently */
+  __atomic_add_fetch(&entry->count, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&entry->total_us, elapsed_us, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&entry->buckets[bucket], 1, __ATOMIC_RELAXED);
+
+  uint64_t max_us = __atomic_load_n(&entry->max_us, __ATOMIC_RELAXED);
+  while (elapsed_us > max_us && !__atomic_compare_exchange_n(&entry->max_us, &max_us, elapsed_us, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+bool module_stats_quarantined(size_t module) {
+  if (!module_stats || module >= module_stats->modules_count) return false;
+
+  return __atomic_load_n(&module_stats_module_get(module)->quarantined, __ATOMIC_ACQUIRE) != 0;
+}
@@ -0,0 +1,70 @@
+#ifndef MODULE_STATS_H
+#define MODULE_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* INFO: Must be kept in sync with zygiskd/src/stats.h */
+
+#define MODULE_STATS_MAGIC 0x534d5a52 /* INFO: "RZMS" */
+#define MODULE_STATS_VERSION 3
+
+#define MODULE_STATS_CALLS_COUNT 64
+
+enum module_stats_phase {
+  MODULE_STATS_ON_LOAD,
+  MODULE_STATS_PRE,
+  MODULE_STATS_POST,
+  MODULE_STATS_PHASES_COUNT
+};
+
+struct module_stats_entry {
+  uint64_t count;
+  uint64_t total_us;
+  uint64_t max_us;
+  uint32_t buckets[];
+};
+
+struct module_stats_call {
+  int32_t pid;
+  uint32_t module;
+};
+
+struct module_stats_module {
+  uint32_t over_budget;
+  uint32_t quarantined;
+  /* INFO: MODULE_STATS_PHASES_COUNT entries, each with buckets_count buckets */
+  uint8_t phases[];
+};
+
+struct module_stats_buffer {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t modules_count;
+  uint32_t buckets_count;
+  uint32_t budget_us;
+  uint32_t reserved;
+  struct module_stats_call calls[MODULE_STATS_CALLS_COUNT];
+  uint8_t modules[];
+};
+
+bool module_stats_attach(int fd);
+
+void module_stats_detach(void);
+
+/* INFO: When ReZygiskd has no buffer, these are a single branch. "module" is the
+           index of the module in ReZygiskd. */
+
+/* INFO: To be called right before a callback, returns its start time. A callback
+           that begins but is never recorded, in a child that is then gone, is
+           what ReZygiskd counts as a crash. */
+uint64_t module_stats_begin(size_t module);
+
+void module_stats_record(size_t module, enum module_stats_phase phase, uint64_t start_us);
+
+/* INFO: Whether ReZygiskd quarantined the module for going over the callback budget
+           or crashing children */
+bool module_stats_quarantined(size_t module);
+
+#endif /* MODULE_STATS_H */
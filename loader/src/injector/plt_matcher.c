@@ -0,0 +1,271 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <regex.h>
+
+#include "logging.h"
+
+#include "plt_matcher.h"
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+/* INFO: Shortest literal worth a strstr before running the regex */
+#define MIN_LITERAL_LEN 3
+
+struct match_result {
+  const char *pattern;
+  const char *path;
+  bool matched;
+};
+
+/* INFO: Open addressing sets, both growing to keep at most half of the slots used.
+           Strings are interned so that results are keyed by pointer. */
+static char **strings = NULL;
+static size_t strings_size = 0;
+static size_t strings_count = 0;
+
+static struct match_result *results = NULL;
+static size_t results_size = 0;
+static size_t results_count = 0;
+
+static uint64_t hash_string(const char *str) {
+  uint64_t hash = FNV_OFFSET_BASIS;
+  for (const char *c = str; *c; c++) {
+    hash ^= (uint8_t)*c;
+    hash *= FNV_PRIME;
+  }
+
+  return hash;
+}
+
+static size_t hash_pair(const char *pattern, const char *path) {
+  uint64_t hash = ((uint64_t)(uintptr_t)pattern * FNV_PRIME) ^ (uint64_t)(uintptr_t)path;
+  hash ^= hash >> 29;
+
+  return (size_t)(hash * FNV_PRIME);
+}
+
+static bool strings_grow(void) {
+  size_t new_size = strings_size ? strings_size * 2 : 256;
+  char **new_strings = calloc(new_size, sizeof(char *));
+  if (!new_strings) {
+    LOGE("Failed to allocate memory for PLT matcher strings");
+
+    return false;
+  }
+
+  for (size_t i = 0; i < strings_size; i++) {
+    if (!strings[i]) continue;
+
+    size_t slot = (size_t)hash_string(strings[i]) & (new_size - 1);
+    while (new_strings[slot]) slot = (slot + 1) & (new_size - 1);
+
+    new_strings[slot] = strings[i];
+  }
+
+  free(strings);
+  strings = new_strings;
+  strings_size = new_size;
+
+  return true;
+}
+
+static const char *intern(const char *str) {
+  if ((strings_count + 1) * 2 > strings_size && !strings_grow()) return NULL;
+
+  size_t slot = (size_t)hash_string(str) & (strings_size - 1);
+  while (strings[slot]) {
+    if (strcmp(strings[slot], str) == 0) return strings[slot];
+
+    slot = (slot + 1) & (strings_size - 1);
+  }
+
+  strings[slot] = strdup(str);
+  if (!strings[slot]) {
+    LOGE("Failed to duplicate PLT matcher string");
+
+    return NULL;
+  }
+
+  strings_count++;
+
+  return strings[slot];
+}
+
+static bool results_grow(void) {
+  size_t new_size = results_size ? results_size * 2 : 256;
+  struct match_result *new_results = calloc(new_size, sizeof(struct match_result));
+  if (!new_results) {
+    LOGE("Failed to allocate memory for PLT matcher results");
+
+    return false;
+  }
+
+  for (size_t i = 0; i < results_size; i++) {
+    if (!results[i].pattern) continue;
+
+    size_t slot = hash_pair(results[i].pattern, results[i].path) & (new_size - 1);
+    while (new_results[slot].pattern) slot = (slot + 1) & (new_size - 1);
+
+    new_results[slot] = results[i];
+  }
+
+  free(results);
+  results = new_results;
+  results_size = new_size;
+
+  return true;
+}
+
+static struct match_result *results_find(const char *pattern, const char *path) {
+  if (results_size == 0) return NULL;
+
+  size_t slot = hash_pair(pattern, path) & (results_size - 1);
+  while (results[slot].pattern) {
+    if (results[slot].pattern == pattern && results[slot].path == path) return &results[slot];
+
+    slot = (slot + 1) & (results_size - 1);
+  }
+
+  return NULL;
+}
+
+static void results_add(const char *pattern, const char *path, bool matched) {
+  if ((results_count + 1) * 2 > results_size && !results_grow()) return;
+
+  size_t slot = hash_pair(pattern, path) & (results_size - 1);
+  while (results[slot].pattern) slot = (slot + 1) & (results_size - 1);
+
+  results[slot] = (struct match_result) {
+    .pattern = pattern,
+    .path = path,
+    .matched = matched
+  };
+  results_count++;
+}
+
+/* INFO: Finds the longest run of plain characters that every match must contain.
+           Patterns are basic regular expressions which, without "\(" or "\|",
+           have no grouping nor alternation: only single atoms, each possibly
+           followed by "*". A run of literal atoms not followed by "*" is therefore
+           mandatory. Anything unusual ends the run, which is always safe. */
+static char *extract_literal(const char *pattern) {
+  size_t pattern_len = strlen(pattern);
+  char *run = malloc(pattern_len + 1);
+  char *best = malloc(pattern_len + 1);
+  if (!run || !best) {
+    free(run);
+    free(best);
+
+    return NULL;
+  }
+
+  size_t best_len = 0, run_len = 0;
+  for (size_t i = 0;; i++) {
+    char c = pattern[i];
+
+    /* INFO: Escaped metacharacters are literals, any other escape may be a group,
+               an alternation or a back-reference, so no literal is assumed. */
+    if (c == '\\') {
+      if (!pattern[i + 1] || !strchr(".[]*^$\\/", pattern[i + 1])) {
+        free(run);
+        free(best);
+
+        return NULL;
+      }
+
+      run[run_len++] = pattern[++i];
+
+      continue;
+    }
+
+    if (c != '\0' && strchr(".[]*^$+?{}()|", c) == NULL) {
+      run[run_len++] = c;
+
+      continue;
+    }
+
+    /* INFO: The quantifier makes the atom before it optional */
+    if ((c == '*' || c == '?' || c == '{') && run_len > 0) run_len--;
+
+    if (run_len > best_len) {
+      memcpy(best, run, run_len);
+      best_len = run_len;
+    }
+    run_len = 0;
+
+    if (c == '\0') break;
+
+    if (c == '[') {
+      /* INFO: A leading "]" (or "^]") is part of the bracket expression */
+      i++;
+      if (pattern[i] == '^') i++;
+      if (pattern[i] == ']') i++;
+      while (pattern[i] && pattern[i] != ']') i++;
+
+      if (!pattern[i]) break;
+    }
+  }
+
+  free(run);
+
+  if (best_len < MIN_LITERAL_LEN) {
+    free(best);
+
+    return NULL;
+  }
+
+  best[best_len] = '\0';
+
+  return best;
+}
+
+bool plt_matcher_compile(struct plt_matcher_pattern *matcher, const char *pattern) {
+  if (regcomp(&matcher->regex, pattern, REG_NOSUB) != 0) return false;
+
+  matcher->pattern = intern(pattern);
+  matcher->literal = extract_literal(pattern);
+
+  return true;
+}
+
+void plt_matcher_free(struct plt_matcher_pattern *matcher) {
+  regfree(&matcher->regex);
+  free(matcher->literal);
+  matcher->literal = NULL;
+  matcher->pattern = NULL;
+}
+
+bool plt_matcher_match(const struct plt_matcher_pattern *matcher, const char *path) {
+  if (matcher->literal && !strstr(path, matcher->literal)) return false;
+
+  const char *interned_path = matcher->pattern ? intern(path) : NULL;
+  if (interned_path) {
+    struct match_result *result = results_find(matcher->pattern, interned_path);
+    if (result) return result->matched;
+  }
+
+  bool matched = regexec(&matcher->regex, path, 0, NULL, 0) == 0;
+  if (interned_path) results_add(matcher->pattern, interned_path, matched);
+
+  return matched;
+}
+
+void plt_matcher_cache_clear(void) {
+  for (size_t i = 0; i < strings_size; i++) {
+    free(strings[i]);
+  }
+
+  free(strings);
+  strings = NULL;
+  strings_size = 0;
+  strings_count = 0;
+
+  free(results);
+  results = NULL;
+  results_size = 0;
+  results_count = 0;
+}
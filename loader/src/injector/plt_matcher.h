@@ -0,0 +1,29 @@
+#ifndef PLT_MATCHER_H
+#define PLT_MATCHER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <regex.h>
+
+/* INFO: A compiled plt_hook_register/plt_hook_exclude path pattern */
+struct plt_matcher_pattern {
+  regex_t regex;
+  /* INFO: Interned, identifies the pattern in the result cache */
+  const char *pattern;
+  /* INFO: Substring every matching path must contain, or NULL if unknown */
+  char *literal;
+};
+
+bool plt_matcher_compile(struct plt_matcher_pattern *matcher, const char *pattern);
+
+void plt_matcher_free(struct plt_matcher_pattern *matcher);
+
+/* INFO: Whether "path" matches. The result is cached per (pattern, path) for
+           the life of the process, or until plt_matcher_cache_clear(). */
+bool plt_matcher_match(const struct plt_matcher_pattern *matcher, const char *path);
+
+/* INFO: Invalidates every compiled pattern still alive, so they must be freed first */
+void plt_matcher_cache_clear(void);
+
+#endif /* PLT_MATCHER_H */
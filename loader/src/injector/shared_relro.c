@@ -0,0 +1,224 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/system_properties.h>
+#include <unistd.h>
+
+#include "daemon.h"
+#include "logging.h"
+
+#include "maps_snapshot.h"
+#include "shared_relro.h"
+
+#ifndef F_ADD_SEALS
+  #define F_ADD_SEALS 1033
+  #define F_GET_SEALS 1034
+  #define F_SEAL_SEAL 0x0001
+  #define F_SEAL_SHRINK 0x0002
+  #define F_SEAL_GROW 0x0004
+  #define F_SEAL_WRITE 0x0008
+#endif
+
+#define SHARED_RELRO_SEALS (F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
+
+struct relro_range {
+  uintptr_t load_bias;
+  uintptr_t start;
+  uintptr_t end;
+};
+
+/* INFO: The ELF header and program headers are in the first mapping of the file,
+           which csoloader maps from offset 0 like the linker does. */
+static bool find_relro(const void *addr, size_t page_size, struct relro_range *range) {
+  const struct maps_snapshot *snapshot = maps_snapshot_get();
+  if (!snapshot) return false;
+
+  const struct map_entry *entry = maps_snapshot_find_addr(snapshot, (uintptr_t)addr);
+  if (!entry || entry->inode == 0) return false;
+
+  const struct map_entry *first = maps_snapshot_find_inode(snapshot, entry->dev, entry->inode);
+  if (!first || first->offset != 0 || !(first->perms & PROT_READ)) return false;
+
+  const ElfW(Ehdr) *ehdr = (const ElfW(Ehdr) *)first->start;
+  if (first->end - first->start < sizeof(*ehdr) || memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0) return false;
+
+  if (ehdr->e_phentsize != sizeof(ElfW(Phdr)) ||
+      ehdr->e_phoff + (size_t)ehdr->e_phnum * sizeof(ElfW(Phdr)) > first->end - first->start) return false;
+
+  const ElfW(Phdr) *phdrs = (const ElfW(Phdr) *)(first->start + ehdr->e_phoff);
+
+  const ElfW(Phdr) *first_load = NULL;
+  const ElfW(Phdr) *relro = NULL;
+  for (size_t i = 0; i < ehdr->e_phnum; i++) {
+    if (phdrs[i].p_type == PT_LOAD && !first_load) first_load = &phdrs[i];
+    else if (phdrs[i].p_type == PT_GNU_RELRO) relro = &phdrs[i];
+  }
+
+  if (!first_load || first_load->p_offset != 0 || !relro) return false;
+
+  range->load_bias = first->start - (first_load->p_vaddr & ~(page_size - 1));
+
+  /* INFO: Only whole pages, so that nothing writable past the RELRO is ever shared */
+  range->start = (range->load_bias + relro->p_vaddr + page_size - 1) & ~(page_size - 1);
+  range->end = (range->load_bias + relro->p_vaddr + relro->p_memsz) & ~(page_size - 1);
+
+  return range->end > range->start;
+}
+
+static bool write_all(int fd, const void *data, size_t size, off_t offset) {
+  const uint8_t *bytes = (const uint8_t *)data;
+
+  while (size > 0) {
+    ssize_t written = pwrite(fd, bytes, size, offset);
+    if (written == -1) {
+      if (errno == EINTR) continue;
+
+      return false;
+    }
+
+    bytes += written;
+    size -= (size_t)written;
+    offset += written;
+  }
+
+  return true;
+}
+
+static bool publish_relro(int fd, const struct relro_range *range, size_t page_size) {
+  struct shared_relro_header header = {
+    .magic = SHARED_RELRO_MAGIC,
+    .version = SHARED_RELRO_VERSION,
+    .page_size = (uint32_t)page_size,
+    .reserved = 0,
+    .load_bias = range->load_bias,
+    .relro_start = range->start - range->load_bias,
+    .relro_size = range->end - range->start
+  };
+
+  if (ftruncate(fd, (off_t)(page_size + header.relro_size)) == -1) {
+    PLOGE("resize shared RELRO");
+
+    return false;
+  }
+
+  if (!write_all(fd, (const void *)range->start, header.relro_size, (off_t)page_size) ||
+      !write_all(fd, &header, sizeof(header), 0)) {
+    PLOGE("write shared RELRO");
+
+    return false;
+  }
+
+  /* INFO: ReZygiskd only hands it out to others once sealed */
+  if (fcntl(fd, F_ADD_SEALS, SHARED_RELRO_SEALS) == -1) {
+    PLOGE("seal shared RELRO");
+
+    return false;
+  }
+
+  return true;
+}
+
+static size_t use_relro(int fd, const struct relro_range *range, size_t page_size) {
+  int seals = fcntl(fd, F_GET_SEALS);
+  if (seals == -1 || (seals & SHARED_RELRO_SEALS) != SHARED_RELRO_SEALS) {
+    LOGE("Shared RELRO is not sealed");
+
+    return 0;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size < page_size) return 0;
+
+  const uint8_t *image = (const uint8_t *)mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (image == MAP_FAILED) {
+    PLOGE("mmap shared RELRO");
+
+    return 0;
+  }
+
+  size_t shared_pages = 0;
+
+  /* INFO: Relocated contents depend on where the module and its dependencies are, so
+             it is only usable when mapped at the same address as the publisher's. */
+  const struct shared_relro_header *header = (const struct shared_relro_header *)image;
+  if (header->magic != SHARED_RELRO_MAGIC || header->version != SHARED_RELRO_VERSION ||
+      header->page_size != page_size || header->load_bias != range->load_bias ||
+      header->relro_start != range->start - range->load_bias || header->relro_size != range->end - range->start ||
+      page_size + header->relro_size > (size_t)st.st_size) {
+    LOGD("Shared RELRO does not match this process");
+
+    goto unmap;
+  }
+
+  /* INFO: Pages that differ, which should not happen, stay private. Contiguous equal
+             ones are replaced with a single mapping. */
+  size_t pages = header->relro_size / page_size;
+  for (size_t i = 0; i < pages;) {
+    if (memcmp((const void *)(range->start + i * page_size), image + page_size + i * page_size, page_size) != 0) {
+      i++;
+
+      continue;
+    }
+
+    size_t run = 1;
+    while (i + run < pages &&
+           memcmp((const void *)(range->start + (i + run) * page_size), image + page_size + (i + run) * page_size, page_size) == 0) run++;
+
+    void *mapped = mmap((void *)(range->start + i * page_size), run * page_size, PROT_READ, MAP_SHARED | MAP_FIXED, fd, (off_t)(page_size + i * page_size));
+    if (mapped == MAP_FAILED) {
+      PLOGE("map shared RELRO pages");
+
+      break;
+    }
+
+    shared_pages += run;
+    i += run;
+  }
+
+  unmap:
+    munmap((void *)image, (size_t)st.st_size);
+
+    return shared_pages;
+}
+
+bool shared_relro_enabled(void) {
+  char value[PROP_VALUE_MAX] = { 0 };
+  __system_property_get("persist.rezygisk.shared_relro", value);
+
+  return strcmp(value, "1") == 0;
+}
+
+void shared_relro_apply(size_t module, const void *addr) {
+  size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+  /* INFO: csoloader maps without the linker, which the snapshot cannot notice */
+  maps_snapshot_invalidate();
+
+  struct relro_range range;
+  if (!find_relro(addr, page_size, &range)) return;
+
+  uint8_t role = SHARED_RELRO_UNAVAILABLE;
+  int fd = rezygiskd_get_module_relro(module, &role);
+  if (fd == -1) return;
+
+  if (role == SHARED_RELRO_PUBLISH && !publish_relro(fd, &range, page_size)) {
+    close(fd);
+
+    return;
+  }
+
+  /* INFO: Publishers share it too, so that their own copy stops being private */
+  size_t shared_pages = use_relro(fd, &range, page_size);
+
+  close(fd);
+
+  maps_snapshot_invalidate();
+
+  LOGD("Shared %zu/%zu RELRO page(s) of module %zu", shared_pages, (range.end - range.start) / page_size, module);
+}
@@ -0,0 +1,41 @@
+#ifndef SHARED_RELRO_H
+#define SHARED_RELRO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* INFO: Must be kept in sync with zygiskd/src/relro.h */
+enum shared_relro_role {
+  SHARED_RELRO_UNAVAILABLE,
+  SHARED_RELRO_PUBLISH,
+  SHARED_RELRO_USE
+};
+
+#define SHARED_RELRO_MAGIC 0x4c525a52 /* INFO: "RZRL" */
+#define SHARED_RELRO_VERSION 1
+
+/* INFO: First page of the memfd, the RELRO itself starts at the second one */
+struct shared_relro_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t page_size;
+  uint32_t reserved;
+  uint64_t load_bias;
+  /* INFO: Relative to the load bias, page aligned */
+  uint64_t relro_start;
+  uint64_t relro_size;
+};
+
+/* INFO: Once a module loaded by csoloader in a Zygote child is relocated, replaces
+           the pages of its RELRO that are identical to the ones another child
+           published with read-only shared mappings of them, like the Android linker
+           does for WebView. The first child to load it publishes its own.
+           "module" is the index of the module in ReZygiskd, "addr" any address in it. */
+void shared_relro_apply(size_t module, const void *addr);
+
+/* INFO: Off unless persist.rezygisk.shared_relro is 1, as the shared pages show up
+           as a memfd in the maps of the process. */
+bool shared_relro_enabled(void);
+
+#endif /* SHARED_RELRO_H */
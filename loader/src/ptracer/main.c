@@ -1,9 +1,33 @@
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <unistd.h>
+
 #include "daemon.h"
 #include "monitor.h"
+#include "trace.h"
+
+static void print_stats(const struct rezygiskd_stat *entries, size_t entries_count, uint32_t buckets_count) {
+  for (size_t i = 0; i < entries_count; i++) {
+    const struct rezygiskd_stat *entry = &entries[i];
+    if (entry->count == 0) continue;
+
+    printf(" - %s: %" PRIu64 " calls, avg %" PRIu64 "us, max %" PRIu64 "us\n",
+           entry->name, entry->count, entry->total_us / entry->count, entry->max_us);
+
+    /* INFO: Bucket 0 is under 1us, bucket i is [2^(i - 1), 2^i) us and the last
+               one is open-ended. */
+    for (uint32_t j = 0; j < buckets_count; j++) {
+      if (entry->buckets[j] == 0) continue;
+
+      if (j == 0) printf("     < 1us: %u\n", entry->buckets[j]);
+      else if (j == buckets_count - 1) printf("     >= %" PRIu64 "us: %u\n", (uint64_t)1 << (j - 1), entry->buckets[j]);
+      else printf("     < %" PRIu64 "us: %u\n", (uint64_t)1 << j, entry->buckets[j]);
+    }
+  }
+}
 
 int main(int argc, char **argv) {
   printf("The ReZygisk Tracer %s\n\n", ZKSU_VERSION);
@@ -101,6 +125,44 @@ int main(int argc, char **argv) {
 
     free_rezygisk_info(&info);
 
+    struct rezygiskd_stats stats;
+    if (!info.running || !rezygiskd_get_stats(&stats)) {
+      printf("Daemon statistics: N/A\n");
+
+      return 0;
+    }
+
+    printf("Daemon statistics:\n");
+    print_stats(stats.entries, stats.entries_count, stats.buckets_count);
+
+    if (stats.module_entries_count != 0) {
+      printf("Module statistics:\n");
+      print_stats(stats.module_entries, stats.module_entries_count, stats.buckets_count);
+    }
+
+    free_rezygiskd_stats(&stats);
+
+    return 0;
+  } else if (argc >= 2 && strcmp(argv[1], "trace-dump") == 0) {
+    int trace_fd = rezygiskd_get_trace_buffer();
+    if (trace_fd == -1) {
+      printf("[ReZygisk]: Tracing is disabled, set persist.rezygisk.trace to 1 (2 to also sample memory) and reboot to enable it\n");
+
+      return 1;
+    }
+
+    bool attached = rz_trace_attach(trace_fd, false);
+    close(trace_fd);
+
+    if (!attached) {
+      printf("[ReZygisk]: Failed to map the trace buffer\n");
+
+      return 1;
+    }
+
+    rz_trace_dump();
+    rz_trace_detach();
+
     return 0;
   } else {
     printf(
@@ -110,6 +172,7 @@ int main(int argc, char **argv) {
       " - ctl <start|stop|exit>\n"
       " - version: Shows the version of ReZygisk.\n"
       " - info: Shows information about the created daemon/injection.\n"
+      " - trace-dump: Shows the per-process timeline of recent spawns.\n"
       "\n"
       "<...>: Obligatory\n"
       "[...]: Optional\n");
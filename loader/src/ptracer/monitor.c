@@ -1,9 +1,11 @@
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <errno.h>
 
 #include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 #include <sys/epoll.h>
 #include <sys/mount.h>
@@ -35,6 +37,77 @@ struct environment_information {
 static struct environment_information environment_information64;
 static struct environment_information environment_information32;
 
+struct module_stats_information {
+  char **names;
+  struct module_stats_report *reports;
+  uint32_t len;
+};
+
+static struct module_stats_information module_stats64;
+static struct module_stats_information module_stats32;
+
+static void free_module_stats_information(struct module_stats_information *info) {
+  if (info->names) for (uint32_t i = 0; i < info->len; i++) {
+    free(info->names[i]);
+  }
+
+  free(info->names);
+  info->names = NULL;
+
+  free(info->reports);
+  info->reports = NULL;
+
+  info->len = 0;
+}
+
+/* INFO: Parses a DAEMON_SET_MODULE_STATS datagram: the command, the count of
+           modules, then the length of the name, the name and the report of each. */
+static bool parse_module_stats(const uint8_t *buf, size_t buf_len, struct module_stats_information *info) {
+  size_t offset = sizeof(uint8_t);
+
+  uint32_t len;
+  if (buf_len - offset < sizeof(len)) return false;
+
+  memcpy(&len, buf + offset, sizeof(len));
+  offset += sizeof(len);
+
+  info->names = calloc(len, sizeof(char *));
+  info->reports = calloc(len, sizeof(struct module_stats_report));
+  if (info->names == NULL || info->reports == NULL) {
+    PLOGE("calloc module stats");
+
+    return false;
+  }
+
+  info->len = len;
+
+  for (uint32_t i = 0; i < len; i++) {
+    uint32_t module_name_len;
+    if (buf_len - offset < sizeof(module_name_len)) return false;
+
+    memcpy(&module_name_len, buf + offset, sizeof(module_name_len));
+    offset += sizeof(module_name_len);
+
+    if (buf_len - offset < (size_t)module_name_len + sizeof(struct module_stats_report)) return false;
+
+    info->names[i] = malloc((size_t)module_name_len + 1);
+    if (info->names[i] == NULL) {
+      PLOGE("malloc module stats name");
+
+      return false;
+    }
+
+    memcpy(info->names[i], buf + offset, module_name_len);
+    info->names[i][module_name_len] = '\0';
+    offset += module_name_len;
+
+    memcpy(&info->reports[i], buf + offset, sizeof(struct module_stats_report));
+    offset += sizeof(struct module_stats_report);
+  }
+
+  return true;
+}
+
 enum ptracer_tracing_state {
   TRACING,
   STOPPING,
@@ -48,6 +121,7 @@ struct rezygiskd_status {
   bool supported;
   bool zygote_injected;
   bool daemon_running;
+  bool daemon_ready;
   pid_t daemon_pid;
   char *daemon_info;
   char *daemon_error_info;
@@ -57,6 +131,7 @@ struct rezygiskd_status status64 = {
   .supported = false,
   .zygote_injected = false,
   .daemon_running = false,
+  .daemon_ready = false,
   .daemon_pid = -1,
   .daemon_info = NULL,
   .daemon_error_info = NULL
@@ -65,6 +140,7 @@ struct rezygiskd_status status32 = {
   .supported = false,
   .zygote_injected = false,
   .daemon_running = false,
+  .daemon_ready = false,
   .daemon_pid = -1,
   .daemon_info = NULL,
   .daemon_error_info = NULL
@@ -175,7 +251,7 @@ bool rezygiskd_listener_init() {
 void rezygiskd_listener_callback() {
   while (1) {
     uint8_t cmd;
-    ssize_t nread = TEMP_FAILURE_RETRY(read(monitor_sock_fd, &cmd, sizeof(cmd)));
+    ssize_t nread = TEMP_FAILURE_RETRY(recv(monitor_sock_fd, &cmd, sizeof(cmd), MSG_PEEK));
     if (nread == -1) {
       if (errno == EINTR || errno == EWOULDBLOCK) break;
 
@@ -184,6 +260,11 @@ void rezygiskd_listener_callback() {
       continue;
     }
 
+    /* INFO: Module stats come as a single datagram led by the command, which their
+               handler reads whole. Every other command is a datagram of its own. */
+    if (cmd != DAEMON64_SET_MODULE_STATS && cmd != DAEMON32_SET_MODULE_STATS)
+      TEMP_FAILURE_RETRY(read(monitor_sock_fd, &cmd, sizeof(cmd)));
+
     switch (cmd) {
       case START: {
         if (tracing_state == STOPPING) {
@@ -349,6 +430,15 @@ void rezygiskd_listener_callback() {
 
         break;
       }
+      case DAEMON64_SET_READY:
+      case DAEMON32_SET_READY: {
+        LOGI("ReZygiskd%s is ready", cmd == DAEMON64_SET_READY ? "64" : "32");
+
+        struct rezygiskd_status *status = cmd == DAEMON64_SET_READY ? &status64 : &status32;
+        status->daemon_ready = true;
+
+        break;
+      }
       case DAEMON64_SET_ERROR_INFO:
       case DAEMON32_SET_ERROR_INFO: {
         LOGD("Received ReZygiskd%s error info", cmd == DAEMON64_SET_ERROR_INFO ? "64" : "32");
@@ -389,6 +479,36 @@ void rezygiskd_listener_callback() {
 
         update_status(NULL);
 
+        break;
+      }
+      case DAEMON64_SET_MODULE_STATS:
+      case DAEMON32_SET_MODULE_STATS: {
+        LOGD("Received ReZygiskd%s module stats", cmd == DAEMON64_SET_MODULE_STATS ? "64" : "32");
+
+        struct module_stats_information *module_stats = cmd == DAEMON64_SET_MODULE_STATS ? &module_stats64 : &module_stats32;
+        free_module_stats_information(module_stats);
+
+        ssize_t buf_len = TEMP_FAILURE_RETRY(recv(monitor_sock_fd, NULL, 0, MSG_PEEK | MSG_TRUNC));
+        uint8_t *buf = buf_len > 0 ? malloc((size_t)buf_len) : NULL;
+        if (buf == NULL) {
+          PLOGE("malloc ReZygiskd%s module stats", cmd == DAEMON64_SET_MODULE_STATS ? "64" : "32");
+
+          TEMP_FAILURE_RETRY(read(monitor_sock_fd, &cmd, sizeof(cmd)));
+
+          break;
+        }
+
+        if (TEMP_FAILURE_RETRY(read(monitor_sock_fd, buf, (size_t)buf_len)) != buf_len ||
+            !parse_module_stats(buf, (size_t)buf_len, module_stats)) {
+          LOGE("read ReZygiskd%s module stats", cmd == DAEMON64_SET_MODULE_STATS ? "64" : "32");
+
+          free_module_stats_information(module_stats);
+        }
+
+        free(buf);
+
+        update_status(NULL);
+
         break;
       }
     }
@@ -454,10 +574,67 @@ static bool ensure_daemon_created(bool is_64bit) {
   status->supported = true;
   status->daemon_pid = pid;
   status->daemon_running = true;
+  status->daemon_ready = false;
 
   return true;
 }
 
+#define DAEMON_READY_TIMEOUT_MS 5000
+
+/* INFO: ReZygiskd is started with the monitor, so by the time Zygote is executed
+           it is usually done with its setup. In case it is not, we wait for it here,
+           handling the messages from ReZygiskd ourselves, as we are inside the
+           sigchld callback and the event loop can't run. */
+static bool wait_daemon_ready(bool is_64bit) {
+  struct rezygiskd_status *status = is_64bit ? &status64 : &status32;
+
+  struct timespec start = { 0 };
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  while (!status->daemon_ready) {
+    if (!status->daemon_running || status->daemon_error_info) return false;
+
+    struct timespec now = { 0 };
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    long elapsed_ms = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+    if (elapsed_ms >= DAEMON_READY_TIMEOUT_MS) {
+      LOGW("ReZygiskd%s not ready after %d ms, continuing anyway", is_64bit ? "64" : "32", DAEMON_READY_TIMEOUT_MS);
+
+      break;
+    }
+
+    struct pollfd pfd = {
+      .fd = monitor_sock_fd,
+      .events = POLLIN
+    };
+
+    int ret = poll(&pfd, 1, (int)(DAEMON_READY_TIMEOUT_MS - elapsed_ms));
+    if (ret == -1) {
+      if (errno == EINTR) continue;
+
+      PLOGE("poll monitor socket");
+
+      break;
+    }
+
+    if (ret > 0) rezygiskd_listener_callback();
+  }
+
+  return status->daemon_running;
+}
+
+/* INFO: The daemons are started as soon as the monitor is, so that the root
+           implementation detection (which may execute binaries) and the modules
+           scan happen way before Zygote starts. */
+static void start_daemons(void) {
+  if (access("./bin/zygiskd64", X_OK) == 0 && !ensure_daemon_created(true))
+    LOGW("Failed to start ReZygiskd64 early, retrying on Zygote start");
+
+  if (access("./bin/zygiskd32", X_OK) == 0 && !ensure_daemon_created(false))
+    LOGW("Failed to start ReZygiskd32 early, retrying on Zygote start");
+}
+
 #define CHECK_DAEMON_EXIT(abi)                                    \
   if (status##abi.supported && pid == status##abi.daemon_pid) {   \
     char status_str[64];                                          \
@@ -497,7 +674,7 @@ static bool ensure_daemon_created(bool is_64bit) {
       break;                                                          \
     }                                                                 \
                                                                       \
-    if (!ensure_daemon_created(is_64)) {                              \
+    if (!ensure_daemon_created(is_64) || !wait_daemon_ready(is_64)) { \
       LOGW("ReZygiskd " #abi "-bit not running, stop injecting");     \
                                                                       \
       tracing_state = STOPPING;                                       \
@@ -508,30 +685,30 @@ static bool ensure_daemon_created(bool is_64bit) {
     }                                                                 \
   }
 
-#define PRE_INJECT_TANGO                                           \
-  if (strcmp(program, "/system_ext/bin/tango_translator") == 0) {  \
-    tracer = "./bin/zygisk-ptrace32";                              \
-    is_tango = true;                                               \
-                                                                   \
-    if (should_stop_inject32()) {                                  \
-      LOGW("Tango restart too many times, stop injecting");        \
-                                                                   \
-      tracing_state = STOPPING;                                    \
-      monitor_stop_reason = "Zygote crashed";                      \
-      ptrace(PTRACE_INTERRUPT, 1, 0, 0);                           \
-                                                                   \
-      break;                                                       \
-    }                                                              \
-                                                                   \
-    if (!ensure_daemon_created(false)) {                           \
-      LOGW("ReZygiskd 32-bit not running, stop injecting");        \
-                                                                   \
-      tracing_state = STOPPING;                                    \
-      monitor_stop_reason = "ReZygiskd not running";               \
-      ptrace(PTRACE_INTERRUPT, 1, 0, 0);                           \
-                                                                   \
-      break;                                                       \
-    }                                                              \
+#define PRE_INJECT_TANGO                                              \
+  if (strcmp(program, "/system_ext/bin/tango_translator") == 0) {     \
+    tracer = "./bin/zygisk-ptrace32";                                 \
+    is_tango = true;                                                  \
+                                                                      \
+    if (should_stop_inject32()) {                                     \
+      LOGW("Tango restart too many times, stop injecting");           \
+                                                                      \
+      tracing_state = STOPPING;                                       \
+      monitor_stop_reason = "Zygote crashed";                         \
+      ptrace(PTRACE_INTERRUPT, 1, 0, 0);                              \
+                                                                      \
+      break;                                                          \
+    }                                                                 \
+                                                                      \
+    if (!ensure_daemon_created(false) || !wait_daemon_ready(false)) { \
+      LOGW("ReZygiskd 32-bit not running, stop injecting");           \
+                                                                      \
+      tracing_state = STOPPING;                                       \
+      monitor_stop_reason = "ReZygiskd not running";                  \
+      ptrace(PTRACE_INTERRUPT, 1, 0, 0);                              \
+                                                                      \
+      break;                                                          \
+    }                                                                 \
   }
 
 int sigchld_signal_fd;
@@ -835,6 +1012,38 @@ static char post_section[1024];
     }                                                                                \
   }
 
+static void write_module_stats_json(FILE *json, const struct module_stats_information *module_stats) {
+  static const char *phases[MODULE_STATS_PHASES_COUNT] = { "on_load", "pre", "post" };
+
+  fprintf(json, "      \"module_stats\": {");
+
+  for (uint32_t i = 0; i < module_stats->len; i++) {
+    const struct module_stats_report *report = &module_stats->reports[i];
+
+    if (i > 0) fprintf(json, ",");
+    fprintf(json, "\n        \"%s\": {", module_stats->names[i]);
+
+    for (size_t phase = 0; phase < MODULE_STATS_PHASES_COUNT; phase++) {
+      uint64_t avg_us = report->count[phase] ? report->total_us[phase] / report->count[phase] : 0;
+
+      if (phase > 0) fprintf(json, ", ");
+      fprintf(json, "\"%s\": { \"count\": %" PRIu64 ", \"avg_us\": %" PRIu64 ", \"max_us\": %" PRIu64 " }",
+              phases[phase], report->count[phase], avg_us, report->max_us[phase]);
+    }
+
+    if (report->quarantine_reason != 0) {
+      const char *reason = report->quarantine_reason == 1 ? "over_budget" : "crashed";
+
+      fprintf(json, ", \"quarantine\": { \"reason\": \"%s\", \"left_s\": %u }", reason, report->quarantine_left_s);
+    }
+
+    fprintf(json, "}");
+  }
+
+  if (module_stats->len > 0) fprintf(json, "\n      }\n");
+  else fprintf(json, "}\n");
+}
+
 static bool update_status(const char *message) {
   FILE *prop = fopen("/data/adb/modules/rezygisk/module.prop", "w");
   if (prop == NULL) {
@@ -911,7 +1120,8 @@ static bool update_status(const char *message) {
           fprintf(json, "\"%s\"", environment_information64.modules[i]);
         }
 
-        fprintf(json, "]\n");
+        fprintf(json, "],\n");
+        write_module_stats_json(json, &module_stats64);
         fprintf(json, "    }");
         if (status32.supported) fprintf(json, ",\n");
         else fprintf(json, "\n");
@@ -928,7 +1138,8 @@ static bool update_status(const char *message) {
           fprintf(json, "\"%s\"", environment_information32.modules[i]);
         }
 
-        fprintf(json, "]\n");
+        fprintf(json, "],\n");
+        write_module_stats_json(json, &module_stats32);
         fprintf(json, "    }\n");
       }
 
@@ -1019,6 +1230,8 @@ void init_monitor() {
 
   monitor_events_register_event(sigchld_listener_callback, sigchld_signal_fd, EPOLLIN | EPOLLET);
 
+  start_daemons();
+
   monitor_events_loop();
 
   /* INFO: Once it stops the loop, we cannot access the epool data, so we
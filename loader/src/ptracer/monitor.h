@@ -2,6 +2,7 @@
 #define MONITOR_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 void init_monitor();
 
@@ -18,7 +19,24 @@ enum rezygiskd_command {
   DAEMON64_SET_INFO = 6,
   DAEMON32_SET_INFO = 7,
   DAEMON64_SET_ERROR_INFO = 8,
-  DAEMON32_SET_ERROR_INFO = 9
+  DAEMON32_SET_ERROR_INFO = 9,
+  DAEMON64_SET_READY = 10,
+  DAEMON32_SET_READY = 11,
+  DAEMON64_SET_MODULE_STATS = 12,
+  DAEMON32_SET_MODULE_STATS = 13
+};
+
+#define MODULE_STATS_PHASES_COUNT 3
+
+/* INFO: Callback timings of a module, indexed by onLoad, pre and post. Must be
+           kept in sync with zygiskd/src/stats.h */
+struct module_stats_report {
+  uint64_t count[MODULE_STATS_PHASES_COUNT];
+  uint64_t total_us[MODULE_STATS_PHASES_COUNT];
+  uint64_t max_us[MODULE_STATS_PHASES_COUNT];
+  /* INFO: 0 if not quarantined, 1 if over the callback budget, 2 if it crashed children */
+  uint32_t quarantine_reason;
+  uint32_t quarantine_left_s;
 };
 
 int send_control_command(enum rezygiskd_command cmd);
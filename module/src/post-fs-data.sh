@@ -29,7 +29,14 @@ create_sys_perm() {
 }
 
 export TMP_PATH=/data/adb/rezygisk
-rm -rf "$TMP_PATH"
+
+# INFO: Keep ReZygiskd's boot cache, it validates itself against the current boot
+for file in "$TMP_PATH"/*; do
+  case "$file" in
+    *.cache) ;;
+    *) rm -rf "$file" ;;
+  esac
+done
 
 create_sys_perm $TMP_PATH
 
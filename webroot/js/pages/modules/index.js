@@ -36,6 +36,27 @@ async function _getModuleNames(modules) {
   return result.stdout.split('\n\n')
 }
 
+const MODULE_STATS_PHASES = [ 'on_load', 'pre', 'post' ]
+
+/* INFO: Average time a spawn spends in the module callbacks, onLoad, pre and post summed */
+function _getSpawnCost(module_stats) {
+  if (!module_stats) return null
+
+  const phases = MODULE_STATS_PHASES.map((phase) => module_stats[phase]).filter((phase) => phase)
+  if (!phases.some((phase) => phase.count > 0)) return null
+
+  return phases.reduce((total, phase) => total + phase.avg_us, 0)
+}
+
+function _getQuarantine(module_stats, strings) {
+  if (!module_stats || !module_stats.quarantine) return null
+
+  const quarantine = module_stats.quarantine
+  const reason = quarantine.reason === 'over_budget' ? strings.quarantineOverBudget : strings.quarantineCrashed
+
+  return `${reason} (${quarantine.left_s}s)`
+}
+
 async function _updateDynamicElement() {
   const ReZygiskState = await _getReZygiskState()
   const all_modules = []
@@ -46,16 +67,27 @@ async function _updateDynamicElement() {
 
     if (daemon.modules && daemon.modules.length > 0) {
       daemon.modules.forEach((module_id) => {
-        const module = all_modules.find((mod) => mod.id === module_id)
+        const module_stats = daemon.module_stats && daemon.module_stats[module_id]
+        const spawnCost = _getSpawnCost(module_stats)
+        const quarantine = _getQuarantine(module_stats, strings)
+
+        let module = all_modules.find((mod) => mod.id === module_id)
         if (module) {
           module.bitsUsed.push(daemon_bit)
         } else {
-          all_modules.push({
+          module = {
             id: module_id,
             name: null,
-            bitsUsed: [ daemon_bit ]
-          })
+            bitsUsed: [ daemon_bit ],
+            spawnCosts: [],
+            quarantines: []
+          }
+
+          all_modules.push(module)
         }
+
+        if (spawnCost !== null) module.spawnCosts.push(`${daemon_bit}: ${spawnCost}us`)
+        if (quarantine !== null) module.quarantines.push(`${daemon_bit}: ${quarantine}`)
       })
     }
   })
@@ -80,6 +112,16 @@ async function _updateDynamicElement() {
             <div class="dimc arch_desc">${strings.arch}</div>
             <div class="dimc" style="margin-left: 5px;">${module.bitsUsed.join(' / ')}</div>
           </div>
+          ${module.spawnCosts.length === 0 ? '' : `
+          <div class="dimc desc" style="font-size: 0.9em; margin-top: 3px; white-space: nowrap; align-items: center; display: flex;">
+            <div class="dimc arch_desc">${strings.spawnCost}</div>
+            <div class="dimc" style="margin-left: 5px;">${module.spawnCosts.join(' / ')}</div>
+          </div>`}
+          ${module.quarantines.length === 0 ? '' : `
+          <div class="dimc desc" style="font-size: 0.9em; margin-top: 3px; white-space: nowrap; align-items: center; display: flex;">
+            <div class="dimc arch_desc">${strings.quarantine}</div>
+            <div class="dimc" style="margin-left: 5px;">${module.quarantines.join(' / ')}</div>
+          </div>`}
         </div>`
     })
   }
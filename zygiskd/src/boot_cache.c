@@ -0,0 +1,231 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "boot_cache.h"
+
+#include "utils.h"
+
+#define BOOT_CACHE_PATH "/data/adb/rezygisk/zygiskd" LP_SELECT("32", "64") ".cache"
+#define BOOT_CACHE_TMP_PATH BOOT_CACHE_PATH ".tmp"
+
+#define BOOT_CACHE_MAGIC 0x435a5252 /* INFO: "RRZC" */
+#define BOOT_CACHE_VERSION 1
+
+#define BOOT_CACHE_MAX_MODULES 1024
+
+#define FNV_PRIME 0x100000001b3ULL
+
+struct boot_cache_header {
+  uint32_t magic;
+  uint32_t version;
+
+  uint8_t has_root;
+  uint64_t root_fingerprint;
+  struct root_impl_state ksu;
+  struct root_impl_state apatch;
+  struct root_impl_state magisk;
+
+  uint8_t has_modules;
+  uint64_t modules_fingerprint;
+  uint32_t modules_len;
+};
+
+static struct boot_cache_header cache;
+static struct boot_cache_module *cache_modules = NULL;
+static bool cache_dirty = false;
+
+uint64_t boot_cache_hash(uint64_t hash, const void *data, size_t len) {
+  const uint8_t *bytes = (const uint8_t *)data;
+
+  for (size_t i = 0; i < len; i++) {
+    hash ^= bytes[i];
+    hash *= FNV_PRIME;
+  }
+
+  return hash;
+}
+
+/* INFO: Files on persistent storage are identified by their (dev, ino, mtime). Files
+           that are recreated on every boot, like the binaries Magisk extracts to its
+           tmpfs, get a new identity each time, so they are identified by their size
+           and first bytes instead. For an ELF, those hold the headers and, with the
+           usual layout, the build ID note, without reading the whole binary. */
+#define BOOT_CACHE_CONTENT_HASH_SIZE 4096
+
+uint64_t boot_cache_hash_path(uint64_t hash, const char *restrict path, bool by_content) {
+  hash = boot_cache_hash(hash, path, strlen(path));
+
+  struct stat st;
+  if (stat(path, &st) == -1) return boot_cache_hash(hash, &(uint8_t){ 0 }, sizeof(uint8_t));
+
+  uint64_t size = (uint64_t)st.st_size;
+  hash = boot_cache_hash(hash, &size, sizeof(size));
+
+  if (!by_content) {
+    uint64_t key[] = {
+      (uint64_t)st.st_dev,
+      (uint64_t)st.st_ino,
+      (uint64_t)st.st_mtim.tv_sec,
+      (uint64_t)st.st_mtim.tv_nsec
+    };
+
+    return boot_cache_hash(hash, key, sizeof(key));
+  }
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return hash;
+
+  char buf[BOOT_CACHE_CONTENT_HASH_SIZE];
+  ssize_t read_bytes = pread(fd, buf, sizeof(buf), 0);
+  if (read_bytes > 0) hash = boot_cache_hash(hash, buf, (size_t)read_bytes);
+
+  close(fd);
+
+  return hash;
+}
+
+void boot_cache_load(void) {
+  memset(&cache, 0, sizeof(cache));
+
+  int fd = open(BOOT_CACHE_PATH, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    if (errno != ENOENT) LOGE("Failed to open boot cache: %s", strerror(errno));
+
+    return;
+  }
+
+  struct boot_cache_header header;
+  if (read(fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) goto invalid;
+  if (header.magic != BOOT_CACHE_MAGIC || header.version != BOOT_CACHE_VERSION) goto invalid;
+
+  if (header.has_modules) {
+    if (header.modules_len > BOOT_CACHE_MAX_MODULES) goto invalid;
+
+    if (header.modules_len != 0) {
+      size_t modules_size = header.modules_len * sizeof(struct boot_cache_module);
+
+      cache_modules = malloc(modules_size);
+      if (cache_modules == NULL) {
+        LOGE("Failed to allocate memory for cached modules");
+
+        goto invalid;
+      }
+
+      if (read(fd, cache_modules, modules_size) != (ssize_t)modules_size) goto invalid;
+
+      for (uint32_t i = 0; i < header.modules_len; i++) {
+        cache_modules[i].name[sizeof(cache_modules[i].name) - 1] = '\0';
+      }
+    }
+  }
+
+  close(fd);
+
+  cache = header;
+
+  return;
+
+  invalid:
+    LOGW("Ignoring invalid boot cache");
+
+    free(cache_modules);
+    cache_modules = NULL;
+
+    close(fd);
+}
+
+bool boot_cache_get_root(uint64_t fingerprint, struct root_impl_state *restrict ksu, struct root_impl_state *restrict apatch, struct root_impl_state *restrict magisk) {
+  if (!cache.has_root || cache.root_fingerprint != fingerprint) return false;
+
+  *ksu = cache.ksu;
+  *apatch = cache.apatch;
+  *magisk = cache.magisk;
+
+  return true;
+}
+
+void boot_cache_set_root(uint64_t fingerprint, const struct root_impl_state *restrict ksu, const struct root_impl_state *restrict apatch, const struct root_impl_state *restrict magisk) {
+  cache.has_root = 1;
+  cache.root_fingerprint = fingerprint;
+  cache.ksu = *ksu;
+  cache.apatch = *apatch;
+  cache.magisk = *magisk;
+
+  cache_dirty = true;
+}
+
+bool boot_cache_get_modules(uint64_t *restrict fingerprint, const struct boot_cache_module **modules, size_t *restrict len) {
+  if (!cache.has_modules) return false;
+
+  *fingerprint = cache.modules_fingerprint;
+  *modules = cache_modules;
+  *len = cache.modules_len;
+
+  return true;
+}
+
+void boot_cache_set_modules(uint64_t fingerprint, struct boot_cache_module *modules, size_t len) {
+  free(cache_modules);
+
+  if (len > BOOT_CACHE_MAX_MODULES) {
+    free(modules);
+
+    cache_modules = NULL;
+    cache.has_modules = 0;
+    cache.modules_len = 0;
+
+    cache_dirty = true;
+
+    return;
+  }
+
+  cache_modules = modules;
+  cache.has_modules = 1;
+  cache.modules_fingerprint = fingerprint;
+  cache.modules_len = (uint32_t)len;
+
+  cache_dirty = true;
+}
+
+void boot_cache_save(void) {
+  if (!cache_dirty) return;
+
+  cache.magic = BOOT_CACHE_MAGIC;
+  cache.version = BOOT_CACHE_VERSION;
+
+  int fd = open(BOOT_CACHE_TMP_PATH, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd == -1) {
+    LOGE("Failed to open boot cache for writing: %s", strerror(errno));
+
+    return;
+  }
+
+  size_t modules_size = cache.modules_len * sizeof(struct boot_cache_module);
+  if (write(fd, &cache, sizeof(cache)) != (ssize_t)sizeof(cache) ||
+      (modules_size != 0 && write(fd, cache_modules, modules_size) != (ssize_t)modules_size)) {
+    LOGE("Failed to write boot cache: %s", strerror(errno));
+
+    close(fd);
+    unlink(BOOT_CACHE_TMP_PATH);
+
+    return;
+  }
+
+  close(fd);
+
+  /* INFO: Rename so that a crash mid-write never leaves a truncated cache behind */
+  if (rename(BOOT_CACHE_TMP_PATH, BOOT_CACHE_PATH) == -1) {
+    LOGE("Failed to rename boot cache: %s", strerror(errno));
+
+    unlink(BOOT_CACHE_TMP_PATH);
+
+    return;
+  }
+
+  cache_dirty = false;
+}
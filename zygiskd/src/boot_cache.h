@@ -0,0 +1,33 @@
+#ifndef BOOT_CACHE_H
+#define BOOT_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "root_impl/common.h"
+
+#define BOOT_CACHE_HASH_INIT 0xcbf29ce484222325ULL
+
+struct boot_cache_module {
+  char name[256];
+  uint8_t loadable;
+};
+
+uint64_t boot_cache_hash(uint64_t hash, const void *data, size_t len);
+
+uint64_t boot_cache_hash_path(uint64_t hash, const char *restrict path, bool by_content);
+
+void boot_cache_load(void);
+
+bool boot_cache_get_root(uint64_t fingerprint, struct root_impl_state *restrict ksu, struct root_impl_state *restrict apatch, struct root_impl_state *restrict magisk);
+
+void boot_cache_set_root(uint64_t fingerprint, const struct root_impl_state *restrict ksu, const struct root_impl_state *restrict apatch, const struct root_impl_state *restrict magisk);
+
+bool boot_cache_get_modules(uint64_t *restrict fingerprint, const struct boot_cache_module **modules, size_t *restrict len);
+
+/* INFO: Takes ownership of "modules" */
+void boot_cache_set_modules(uint64_t fingerprint, struct boot_cache_module *modules, size_t len);
+
+void boot_cache_save(void);
+
+#endif /* BOOT_CACHE_H */
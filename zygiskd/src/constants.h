@@ -9,6 +9,8 @@
 #define ZYGOTE_INJECTED LP_SELECT(5, 4)
 #define DAEMON_SET_INFO LP_SELECT(7, 6)
 #define DAEMON_SET_ERROR_INFO LP_SELECT(9, 8)
+#define DAEMON_SET_READY LP_SELECT(11, 10)
+#define DAEMON_SET_MODULE_STATS LP_SELECT(13, 12)
 
 enum DaemonSocketAction {
   ZygoteInjected         = 0,
@@ -19,7 +21,11 @@ enum DaemonSocketAction {
   GetModuleDir           = 5,
   ZygoteRestart          = 6,
   UpdateMountNamespace   = 7,
-  RemoveModule           = 8
+  RemoveModule           = 8,
+  GetStats               = 9,
+  GetTraceBuffer         = 10,
+  GetModuleStatsBuffer   = 11,
+  GetModuleRelro         = 12
 };
 
 enum ProcessFlags: uint32_t {
@@ -0,0 +1,265 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/system_properties.h>
+#include <unistd.h>
+
+#include "log.h"
+
+#include "utils.h"
+
+/* INFO: Must be a power of two, so that the 32-bit positions wrap onto the same slot */
+#define LOG_QUEUE_CAPACITY 128
+#define LOG_MESSAGE_MAX 512
+
+struct log_record {
+  /* INFO: Position + 1 once written, position + LOG_QUEUE_CAPACITY once consumed */
+  uint32_t seq;
+  int prio;
+  const char *tag;
+  char message[LOG_MESSAGE_MAX];
+};
+
+static struct log_record queue[LOG_QUEUE_CAPACITY];
+static uint32_t enqueue_pos = 0;
+static uint32_t dequeue_pos = 0;
+static uint32_t dropped = 0;
+
+static int runtime_level = ZYGISKD_LOG_MIN_LEVEL;
+static bool async_enabled = false;
+static bool consumer_sleeping = false;
+static int wake_fd = -1;
+
+/* INFO: Only taken by consumers, producers never block */
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void log_init(void) {
+  char value[PROP_VALUE_MAX];
+  get_property("persist.rezygisk.log_level", value);
+
+  switch (value[0]) {
+    case 'V': { runtime_level = ANDROID_LOG_VERBOSE; break; }
+    case 'D': { runtime_level = ANDROID_LOG_DEBUG; break; }
+    case 'I': { runtime_level = ANDROID_LOG_INFO; break; }
+    case 'W': { runtime_level = ANDROID_LOG_WARN; break; }
+    case 'E': { runtime_level = ANDROID_LOG_ERROR; break; }
+  }
+}
+
+static void log_write(int prio, const char *tag, const char *message) {
+  __android_log_write(prio, tag, message);
+  fputs(message, stdout);
+}
+
+static bool log_callsite_allow(struct log_callsite *callsite, uint32_t *suppressed) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+
+  /* INFO: 0 is the initial value, so the first window must never be 0 */
+  uint32_t now = (uint32_t)ts.tv_sec + 1;
+
+  uint32_t window = __atomic_load_n(&callsite->window, __ATOMIC_RELAXED);
+  if (window != now && __atomic_compare_exchange_n(&callsite->window, &window, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    __atomic_store_n(&callsite->count, 0, __ATOMIC_RELAXED);
+    *suppressed = __atomic_exchange_n(&callsite->suppressed, 0, __ATOMIC_RELAXED);
+  }
+
+  if (__atomic_fetch_add(&callsite->count, 1, __ATOMIC_RELAXED) < LOG_RATELIMIT_BURST) return true;
+
+  __atomic_fetch_add(&callsite->suppressed, 1, __ATOMIC_RELAXED);
+
+  return false;
+}
+
+static bool log_enqueue(int prio, const char *tag, const char *message) {
+  uint32_t pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+  while (1) {
+    struct log_record *record = &queue[pos % LOG_QUEUE_CAPACITY];
+
+    int32_t diff = (int32_t)(__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) - pos);
+    if (diff < 0) return false;
+
+    if (diff > 0) {
+      pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+
+      continue;
+    }
+
+    if (!__atomic_compare_exchange_n(&enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) continue;
+
+    record->prio = prio;
+    record->tag = tag;
+    memcpy(record->message, message, strlen(message) + 1);
+
+    __atomic_store_n(&record->seq, pos + 1, __ATOMIC_RELEASE);
+
+    return true;
+  }
+}
+
+static bool log_pending(void) {
+  uint32_t pos = __atomic_load_n(&dequeue_pos, __ATOMIC_RELAXED);
+
+  return __atomic_load_n(&queue[pos % LOG_QUEUE_CAPACITY].seq, __ATOMIC_ACQUIRE) == pos + 1;
+}
+
+static void log_drain(void) {
+  pthread_mutex_lock(&drain_lock);
+
+  while (log_pending()) {
+    uint32_t pos = __atomic_load_n(&dequeue_pos, __ATOMIC_RELAXED);
+    struct log_record *record = &queue[pos % LOG_QUEUE_CAPACITY];
+
+    log_write(record->prio, record->tag, record->message);
+
+    __atomic_store_n(&dequeue_pos, pos + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&record->seq, pos + LOG_QUEUE_CAPACITY, __ATOMIC_RELEASE);
+  }
+
+  uint32_t lost = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+  if (lost != 0) {
+    char message[64];
+    snprintf(message, sizeof(message), "Dropped %u log messages, queue was full", lost);
+
+    log_write(ANDROID_LOG_WARN, LOG_TAG, message);
+  }
+
+  pthread_mutex_unlock(&drain_lock);
+}
+
+static void log_submit(int prio, const char *tag, const char *message) {
+  if (!__atomic_load_n(&async_enabled, __ATOMIC_ACQUIRE)) {
+    log_write(prio, tag, message);
+
+    return;
+  }
+
+  if (!log_enqueue(prio, tag, message)) {
+    __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+
+    return;
+  }
+
+  /* INFO: Pairs with the fence in log_thread, so that either the consumer sees the
+             record or we see it sleeping and wake it up. */
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&consumer_sleeping, __ATOMIC_RELAXED)) {
+    /* INFO: A failed wake up is harmless, the consumer catches up on the next message */
+    uint64_t one = 1;
+    ssize_t ret = write(wake_fd, &one, sizeof(one));
+    (void)ret;
+  }
+}
+
+void zygiskd_log(int prio, const char *tag, struct log_callsite *callsite, const char *fmt, ...) {
+  if (prio < runtime_level) return;
+
+  uint32_t suppressed = 0;
+  if (!log_callsite_allow(callsite, &suppressed)) return;
+
+  if (suppressed != 0) {
+    char note[128];
+    snprintf(note, sizeof(note), "Suppressed %u messages from %s:%d", suppressed, callsite->file, callsite->line);
+
+    log_submit(ANDROID_LOG_WARN, tag, note);
+  }
+
+  /* INFO: Formatting happens here, as the arguments, like strings on the caller's
+             stack, do not outlive the call. Only the writes to logd and stdout,
+             which are the slow part, are deferred. */
+  char message[LOG_MESSAGE_MAX];
+
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(message, sizeof(message), fmt, args);
+  va_end(args);
+
+  log_submit(prio, tag, message);
+}
+
+static void *log_thread(void *arg) {
+  (void)arg;
+
+  while (1) {
+    log_drain();
+
+    __atomic_store_n(&consumer_sleeping, true, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (!log_pending()) {
+      uint64_t value;
+      if (read(wake_fd, &value, sizeof(value)) == -1 && errno != EINTR) {
+        /* INFO: Without a way to wait, fall back to logging synchronously */
+        __atomic_store_n(&async_enabled, false, __ATOMIC_RELEASE);
+        __atomic_store_n(&consumer_sleeping, false, __ATOMIC_RELAXED);
+
+        log_drain();
+
+        return NULL;
+      }
+    }
+
+    __atomic_store_n(&consumer_sleeping, false, __ATOMIC_RELAXED);
+  }
+}
+
+/* INFO: Forked children, like the ones executing root implementation binaries, do
+           not have the consumer thread anymore. */
+static void log_atfork_child(void) {
+  async_enabled = false;
+  pthread_mutex_init(&drain_lock, NULL);
+}
+
+void log_flush(void) {
+  if (!__atomic_load_n(&async_enabled, __ATOMIC_ACQUIRE)) return;
+
+  log_drain();
+  fflush(stdout);
+}
+
+void log_start_async(void) {
+  for (uint32_t i = 0; i < LOG_QUEUE_CAPACITY; i++) {
+    queue[i].seq = i;
+  }
+
+  wake_fd = eventfd(0, EFD_CLOEXEC);
+  if (wake_fd == -1) {
+    LOGE("Failed to create log wake eventfd: %s", strerror(errno));
+
+    return;
+  }
+
+  pthread_atfork(NULL, NULL, log_atfork_child);
+
+  /* INFO: Signals must keep being delivered to the main thread */
+  sigset_t all_signals, old_signals;
+  sigfillset(&all_signals);
+  pthread_sigmask(SIG_SETMASK, &all_signals, &old_signals);
+
+  pthread_t thread;
+  int ret = pthread_create(&thread, NULL, log_thread, NULL);
+
+  pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+  if (ret != 0) {
+    LOGE("Failed to create log thread: %s", strerror(ret));
+
+    close(wake_fd);
+    wake_fd = -1;
+
+    return;
+  }
+
+  pthread_detach(thread);
+
+  atexit(log_flush);
+
+  __atomic_store_n(&async_enabled, true, __ATOMIC_RELEASE);
+}
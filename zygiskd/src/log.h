@@ -0,0 +1,48 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdint.h>
+
+#include <android/log.h>
+
+/* INFO: Messages below this priority are compiled out entirely */
+#ifndef ZYGISKD_LOG_MIN_LEVEL
+  #ifdef DEBUG
+    #define ZYGISKD_LOG_MIN_LEVEL ANDROID_LOG_VERBOSE
+  #else
+    #define ZYGISKD_LOG_MIN_LEVEL ANDROID_LOG_INFO
+  #endif
+#endif
+
+/* INFO: Each call site may log this many messages per second, the rest are counted
+           and reported once the call site logs again in a later second. */
+#define LOG_RATELIMIT_BURST 20
+
+struct log_callsite {
+  const char *file;
+  int line;
+  uint32_t window;
+  uint32_t count;
+  uint32_t suppressed;
+};
+
+#define ZYGISKD_LOG(prio, tag, ...)                                                     \
+  do {                                                                                  \
+    if ((prio) >= ZYGISKD_LOG_MIN_LEVEL) {                                              \
+      static struct log_callsite log_callsite = { .file = __FILE__, .line = __LINE__ }; \
+      zygiskd_log((prio), (tag), &log_callsite, __VA_ARGS__);                           \
+    }                                                                                   \
+  } while (0)
+
+void zygiskd_log(int prio, const char *tag, struct log_callsite *callsite, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+
+/* INFO: Reads the runtime level from persist.rezygisk.log_level (V, D, I, W or E) */
+void log_init(void);
+
+/* INFO: Moves the writes to logd and stdout to a background thread. Only meant for
+           the long-lived daemon, every other mode keeps logging synchronously. */
+void log_start_async(void);
+
+void log_flush(void);
+
+#endif /* LOG_H */
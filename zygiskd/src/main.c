@@ -2,12 +2,15 @@
 #include <string.h>
 
 #include "root_impl/common.h"
+#include "boot_cache.h"
 #include "companion.h"
 #include "zygiskd.h"
 
 #include "utils.h"
 
 int main(int argc, char *argv[]) {
+  log_init();
+
   LOGI("Welcome to ReZygiskd%s", LP_SELECT("32", "64"));
 
   if (argc > 1) {
@@ -56,6 +59,9 @@ int main(int argc, char *argv[]) {
 
     return 1;
   }
+  log_start_async();
+
+  boot_cache_load();
   root_impls_setup();
   zygiskd_start(argv);
 
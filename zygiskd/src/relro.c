@@ -0,0 +1,73 @@
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "relro.h"
+
+#include "stats.h"
+#include "utils.h"
+
+#ifndef MFD_CLOEXEC
+  #define MFD_CLOEXEC 0x0001U
+#endif
+
+#ifndef MFD_ALLOW_SEALING
+  #define MFD_ALLOW_SEALING 0x0002U
+#endif
+
+#ifndef F_GET_SEALS
+  #define F_GET_SEALS 1034
+#endif
+
+#ifndef F_SEAL_SEAL
+  #define F_SEAL_SEAL 0x0001
+#endif
+
+/* INFO: A publisher that has not sealed the memfd by then is assumed to have died */
+#define MODULE_RELRO_PUBLISH_TIMEOUT_US (10 * 1000000)
+
+void module_relro_init(struct module_relro *relro) {
+  relro->fd = -1;
+  relro->publish_start_us = 0;
+}
+
+void module_relro_reset(struct module_relro *relro) {
+  if (relro->fd >= 0) close(relro->fd);
+
+  module_relro_init(relro);
+}
+
+enum module_relro_role module_relro_get(struct module_relro *relro, int *fd) {
+  if (relro->fd >= 0) {
+    int seals = fcntl(relro->fd, F_GET_SEALS);
+    if (seals != -1 && (seals & F_SEAL_SEAL)) {
+      *fd = relro->fd;
+
+      return MODULE_RELRO_USE;
+    }
+
+    if (stats_now_us() - relro->publish_start_us < MODULE_RELRO_PUBLISH_TIMEOUT_US) return MODULE_RELRO_UNAVAILABLE;
+
+    LOGW("Module RELRO was never published, retrying with another process");
+
+    module_relro_reset(relro);
+  }
+
+  /* INFO: API 25 bionic has no memfd_create wrapper */
+  int relro_fd = (int)syscall(__NR_memfd_create, "rezygisk-module-relro", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (relro_fd == -1) {
+    LOGE("Failed to create module RELRO memfd: %s", strerror(errno));
+
+    return MODULE_RELRO_UNAVAILABLE;
+  }
+
+  relro->fd = relro_fd;
+  relro->publish_start_us = stats_now_us();
+
+  *fd = relro_fd;
+
+  return MODULE_RELRO_PUBLISH;
+}
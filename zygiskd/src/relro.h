@@ -0,0 +1,31 @@
+#ifndef RELRO_H
+#define RELRO_H
+
+#include <stdint.h>
+
+/* INFO: Must be kept in sync with loader/src/injector/shared_relro.h */
+enum module_relro_role {
+  MODULE_RELRO_UNAVAILABLE,
+  /* INFO: The requester relocated the module first, and fills the memfd with its RELRO */
+  MODULE_RELRO_PUBLISH,
+  /* INFO: The memfd is sealed, and its pages can replace identical local ones */
+  MODULE_RELRO_USE
+};
+
+/* INFO: Relocated RELRO of a module that Zygote children load themselves, shared
+           between those that map it at the same address. */
+struct module_relro {
+  int fd;
+  uint64_t publish_start_us;
+};
+
+void module_relro_init(struct module_relro *relro);
+
+/* INFO: Drops the image, as a new Zygote maps modules at other addresses */
+void module_relro_reset(struct module_relro *relro);
+
+/* INFO: ReZygiskd serves one request at a time, so only one child is ever told to
+           publish. "fd" is left untouched for MODULE_RELRO_UNAVAILABLE. */
+enum module_relro_role module_relro_get(struct module_relro *relro, int *fd);
+
+#endif /* RELRO_H */
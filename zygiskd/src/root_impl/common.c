@@ -1,7 +1,12 @@
+#include <stdlib.h>
+#include <string.h>
+
 #include <sys/types.h>
+#include <sys/utsname.h>
 
 #include "common.h"
 
+#include "../boot_cache.h"
 #include "../utils.h"
 #include "apatch.h"
 #include "kernelsu.h"
@@ -9,15 +14,62 @@
 
 static struct root_impl impl;
 
+static const struct {
+  const char *path;
+  bool by_content;
+} root_impl_files[] = {
+  { "/data/adb/ksu/bin/ksud", false },
+  { "/data/adb/ap/bin/apd", false },
+  { "/data/adb/apd", false },
+  { SBIN_MAGISK, true },
+  { BITLESS_SBIN_MAGISK, true },
+  { DEBUG_RAMDISK_MAGISK, true },
+  { BITLESS_DEBUG_RAMDISK_MAGISK, true }
+};
+
+/* INFO: Everything the detection of each root implementation depends on: its binaries,
+           the PATH APatch is checked against and the kernel KernelSU is built into. */
+static uint64_t root_impls_fingerprint(void) {
+  uint64_t hash = BOOT_CACHE_HASH_INIT;
+
+  for (size_t i = 0; i < sizeof(root_impl_files) / sizeof(root_impl_files[0]); i++) {
+    hash = boot_cache_hash_path(hash, root_impl_files[i].path, root_impl_files[i].by_content);
+  }
+
+  const char *PATH = getenv("PATH");
+  if (PATH) hash = boot_cache_hash(hash, PATH, strlen(PATH));
+
+  struct utsname uts;
+  if (uname(&uts) == 0) {
+    hash = boot_cache_hash(hash, uts.release, strlen(uts.release));
+    hash = boot_cache_hash(hash, uts.version, strlen(uts.version));
+  }
+
+  return hash;
+}
+
 void root_impls_setup(void) {
   struct root_impl_state state_ksu;
-  ksu_get_existence(&state_ksu);
-
   struct root_impl_state state_apatch;
-  apatch_get_existence(&state_apatch);
-
   struct root_impl_state state_magisk;
-  magisk_get_existence(&state_magisk);
+
+  uint64_t fingerprint = root_impls_fingerprint();
+  if (boot_cache_get_root(fingerprint, &state_ksu, &state_apatch, &state_magisk)) {
+    LOGI("Using cached root implementation detection results\n");
+
+    /* INFO: KernelSU keeps its driver fd and interface details from detection, so it
+               must always be detected again. It is only syscalls, unlike the others,
+               which have to execute their binaries to get the version. */
+    if (state_ksu.state == Supported) ksu_get_existence(&state_ksu);
+
+    if (state_magisk.state == Supported && !magisk_find_binary()) magisk_get_existence(&state_magisk);
+  } else {
+    ksu_get_existence(&state_ksu);
+    apatch_get_existence(&state_apatch);
+    magisk_get_existence(&state_magisk);
+
+    boot_cache_set_root(fingerprint, &state_ksu, &state_apatch, &state_magisk);
+  }
 
   /* INFO: Check if it's only one supported, if not, it's multile and that's bad.
             Remember that true here is equal to the integer 1. */
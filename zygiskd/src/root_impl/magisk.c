@@ -11,15 +11,10 @@
 #include "../utils.h"
 #include "common.h"
 
-#define SBIN_MAGISK LP_SELECT("/sbin/magisk32", "/sbin/magisk64")
-#define BITLESS_SBIN_MAGISK "/sbin/magisk"
-#define DEBUG_RAMDISK_MAGISK LP_SELECT("/debug_ramdisk/magisk32", "/debug_ramdisk/magisk64")
-#define BITLESS_DEBUG_RAMDISK_MAGISK "/debug_ramdisk/magisk"
-
 /* INFO: Longest path */
 static char path_to_magisk[sizeof(DEBUG_RAMDISK_MAGISK)] = { 0 };
 
-void magisk_get_existence(struct root_impl_state *state) {
+bool magisk_find_binary(void) {
   const char *magisk_files[] = {
     SBIN_MAGISK,
     BITLESS_SBIN_MAGISK,
@@ -32,10 +27,14 @@ void magisk_get_existence(struct root_impl_state *state) {
 
     strcpy(path_to_magisk, magisk_files[i]);
 
-    break;
+    return true;
   }
 
-  if (path_to_magisk[0] == '\0') {
+  return false;
+}
+
+void magisk_get_existence(struct root_impl_state *state) {
+  if (!magisk_find_binary()) {
     state->state = Inexistent;
 
     return;
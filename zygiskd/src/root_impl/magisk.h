@@ -3,6 +3,14 @@
 
 #include "common.h"
 
+#define SBIN_MAGISK LP_SELECT("/sbin/magisk32", "/sbin/magisk64")
+#define BITLESS_SBIN_MAGISK "/sbin/magisk"
+#define DEBUG_RAMDISK_MAGISK LP_SELECT("/debug_ramdisk/magisk32", "/debug_ramdisk/magisk64")
+#define BITLESS_DEBUG_RAMDISK_MAGISK "/debug_ramdisk/magisk"
+
+/* INFO: Only locates the binary, without executing it to check its version */
+bool magisk_find_binary(void);
+
 void magisk_get_existence(struct root_impl_state *state);
 
 bool magisk_uid_granted_root(uid_t uid);
@@ -0,0 +1,371 @@
+#include <inttypes.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/system_properties.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+#include "utils.h"
+
+#ifndef MFD_CLOEXEC
+  #define MFD_CLOEXEC 0x0001U
+#endif
+
+/* INFO: ReZygiskd serves one request at a time, so these are only ever touched
+           by the accept loop and need neither locks nor atomics. */
+static struct stats_entry stats[STATS_EVENTS_COUNT];
+
+uint64_t stats_now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+void stats_record(enum stats_event event, uint64_t start_us) {
+  if ((unsigned int)event >= STATS_EVENTS_COUNT) return;
+
+  uint64_t elapsed_us = stats_now_us() - start_us;
+
+  size_t bucket = 0;
+  while (bucket < STATS_BUCKETS - 1 && (elapsed_us >> bucket) != 0) bucket++;
+
+  struct stats_entry *entry = &stats[event];
+  entry->count++;
+  entry->total_us += elapsed_us;
+  if (elapsed_us > entry->max_us) entry->max_us = elapsed_us;
+  entry->buckets[bucket]++;
+}
+
+const struct stats_entry *stats_get(enum stats_event event) {
+  return &stats[event];
+}
+
+const char *stats_event_name(enum stats_event event) {
+  /* INFO: Cast, as the action events are not enumerators of stats_event */
+  switch ((int)event) {
+    case ZygoteInjected:         return "ZygoteInjected";
+    case GetProcessFlags:        return "GetProcessFlags";
+    case GetInfo:                return "GetInfo";
+    case ReadModules:            return "ReadModules";
+    case RequestCompanionSocket: return "RequestCompanionSocket";
+    case GetModuleDir:           return "GetModuleDir";
+    case ZygoteRestart:          return "ZygoteRestart";
+    case UpdateMountNamespace:   return "UpdateMountNamespace";
+    case RemoveModule:           return "RemoveModule";
+    case GetStats:               return "GetStats";
+    case GetTraceBuffer:         return "GetTraceBuffer";
+    case GetModuleStatsBuffer:   return "GetModuleStatsBuffer";
+    case GetModuleRelro:         return "GetModuleRelro";
+    case STATS_ROOT_BACKEND:     return "Root implementation queries";
+    case STATS_MNS_BUILD:        return "Mount namespace builds";
+    case STATS_COMPANION_SPAWN:  return "Companion spawns";
+  }
+
+  return "Unknown";
+}
+
+#define MODULE_BUDGET_DEFAULT_MS 1000
+/* INFO: Budget overruns or crashes within the strikes window that quarantine a module */
+#define MODULE_QUARANTINE_STRIKES 3
+#define MODULE_QUARANTINE_STRIKES_WINDOW_US (10ULL * 60 * 1000000)
+#define MODULE_QUARANTINE_COOLDOWN_US (30ULL * 60 * 1000000)
+/* INFO: Also the time a callback has to return before it is counted as a crash */
+#define MODULE_QUARANTINE_CHECK_INTERVAL_US (5 * 1000000)
+
+/* INFO: Bookkeeping of ReZygiskd, which children never see */
+struct module_quarantine {
+  enum module_quarantine_reason reason;
+  uint64_t released_at_us;
+
+  uint32_t strikes;
+  uint64_t first_strike_us;
+
+  uint32_t over_budget_seen;
+};
+
+static int module_stats_fd = -1;
+static struct module_stats_buffer *module_stats = NULL;
+static struct module_quarantine *module_quarantines = NULL;
+
+static uint32_t module_budget_us(void) {
+  char value[PROP_VALUE_MAX];
+  get_property("persist.rezygisk.module_budget_ms", value);
+
+  if (value[0] == '\0') return MODULE_BUDGET_DEFAULT_MS * 1000;
+
+  char *end = NULL;
+  unsigned long budget_ms = strtoul(value, &end, 10);
+  if (*end != '\0' || budget_ms > UINT32_MAX / 1000) {
+    LOGW("Invalid persist.rezygisk.module_budget_ms: %s", value);
+
+    return MODULE_BUDGET_DEFAULT_MS * 1000;
+  }
+
+  return (uint32_t)budget_ms * 1000;
+}
+
+void module_stats_init(size_t modules_count) {
+  if (modules_count == 0) return;
+
+  size_t size = sizeof(struct module_stats_buffer) + modules_count * sizeof(struct module_stats_module);
+
+  module_quarantines = calloc(modules_count, sizeof(struct module_quarantine));
+  if (module_quarantines == NULL) {
+    LOGE("Failed to allocate module quarantine state");
+
+    return;
+  }
+
+  /* INFO: API 25 bionic has no memfd_create wrapper */
+  int fd = (int)syscall(__NR_memfd_create, "rezygisk-module-stats", MFD_CLOEXEC);
+  if (fd == -1) {
+    LOGE("Failed to create module stats buffer: %s", strerror(errno));
+
+    goto cleanup;
+  }
+
+  if (ftruncate(fd, (off_t)size) == -1) {
+    LOGE("Failed to resize module stats buffer: %s", strerror(errno));
+
+    close(fd);
+
+    goto cleanup;
+  }
+
+  struct module_stats_buffer *buffer = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (buffer == MAP_FAILED) {
+    LOGE("Failed to map module stats buffer: %s", strerror(errno));
+
+    close(fd);
+
+    goto cleanup;
+  }
+
+  buffer->magic = MODULE_STATS_MAGIC;
+  buffer->version = MODULE_STATS_VERSION;
+  buffer->modules_count = (uint32_t)modules_count;
+  buffer->buckets_count = STATS_BUCKETS;
+  buffer->budget_us = module_budget_us();
+  for (size_t i = 0; i < MODULE_STATS_CALLS_COUNT; i++) {
+    buffer->calls[i].module = UINT32_MAX;
+  }
+
+  module_stats_fd = fd;
+  module_stats = buffer;
+
+  return;
+
+  cleanup:
+    free(module_quarantines);
+    module_quarantines = NULL;
+}
+
+int module_stats_get_fd(void) {
+  return module_stats_fd;
+}
+
+size_t module_stats_modules_count(void) {
+  if (module_stats == NULL) return 0;
+
+  return __atomic_load_n(&module_stats->modules_count, __ATOMIC_RELAXED);
+}
+
+void module_stats_get(size_t module, enum module_stats_phase phase, struct stats_entry *entry) {
+  memset(entry, 0, sizeof(*entry));
+
+  if (module >= module_stats_modules_count()) return;
+
+  const struct stats_entry *shared = &module_stats->modules[module].phases[phase];
+
+  entry->count = __atomic_load_n(&shared->count, __ATOMIC_RELAXED);
+  entry->total_us = __atomic_load_n(&shared->total_us, __ATOMIC_RELAXED);
+  entry->max_us = __atomic_load_n(&shared->max_us, __ATOMIC_RELAXED);
+  for (size_t i = 0; i < STATS_BUCKETS; i++) {
+    entry->buckets[i] = __atomic_load_n(&shared->buckets[i], __ATOMIC_RELAXED);
+  }
+}
+
+static uint64_t module_stats_calls_finished(size_t module) {
+  uint64_t finished = 0;
+  for (size_t phase = 0; phase < MODULE_STATS_PHASES_COUNT; phase++) {
+    finished += __atomic_load_n(&module_stats->modules[module].phases[phase].count, __ATOMIC_RELAXED);
+  }
+
+  return finished;
+}
+
+uint64_t module_stats_total_count(void) {
+  uint64_t total = 0;
+
+  size_t modules_count = module_stats_modules_count();
+  for (size_t i = 0; i < modules_count; i++) {
+    total += module_stats_calls_finished(i);
+  }
+
+  return total;
+}
+
+void module_stats_remove(size_t module) {
+  size_t modules_count = module_stats_modules_count();
+  if (module >= modules_count) return;
+
+  memmove(&module_stats->modules[module], &module_stats->modules[module + 1], (modules_count - module - 1) * sizeof(struct module_stats_module));
+  memset(&module_stats->modules[modules_count - 1], 0, sizeof(struct module_stats_module));
+
+  memmove(&module_quarantines[module], &module_quarantines[module + 1], (modules_count - module - 1) * sizeof(struct module_quarantine));
+  memset(&module_quarantines[modules_count - 1], 0, sizeof(struct module_quarantine));
+
+  /* INFO: Keep held call slots pointing to the same modules */
+  for (size_t i = 0; i < MODULE_STATS_CALLS_COUNT; i++) {
+    uint32_t call_module = __atomic_load_n(&module_stats->calls[i].module, __ATOMIC_ACQUIRE);
+    if (call_module == UINT32_MAX || call_module < module) continue;
+
+    uint32_t new_module = call_module == module ? UINT32_MAX : call_module - 1;
+    __atomic_compare_exchange_n(&module_stats->calls[i].module, &call_module, new_module, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+  }
+
+  __atomic_store_n(&module_stats->modules_count, (uint32_t)(modules_count - 1), __ATOMIC_RELEASE);
+}
+
+const char *module_stats_phase_name(enum module_stats_phase phase) {
+  switch (phase) {
+    case MODULE_STATS_ON_LOAD:      return "onLoad";
+    case MODULE_STATS_PRE:          return "pre";
+    case MODULE_STATS_POST:         return "post";
+    case MODULE_STATS_PHASES_COUNT: break;
+  }
+
+  return "Unknown";
+}
+
+static void module_quarantine_strike(size_t module, struct module_quarantine *quarantine, enum module_quarantine_reason reason, uint32_t strikes, uint64_t now_us) {
+  if (quarantine->strikes == 0 || now_us - quarantine->first_strike_us > MODULE_QUARANTINE_STRIKES_WINDOW_US) {
+    quarantine->strikes = 0;
+    quarantine->first_strike_us = now_us;
+  }
+
+  quarantine->strikes += strikes;
+  if (quarantine->strikes < MODULE_QUARANTINE_STRIKES) return;
+
+  LOGW("Quarantining module %zu: %s", module, module_quarantine_reason_name(reason));
+
+  quarantine->reason = reason;
+  quarantine->released_at_us = now_us + MODULE_QUARANTINE_COOLDOWN_US;
+  quarantine->strikes = 0;
+
+  __atomic_store_n(&module_stats->modules[module].quarantined, 1, __ATOMIC_RELEASE);
+}
+
+/* INFO: Frees the call slots held by children that are gone, counting each one
+           as a lost callback of its module. A pid reused before the check only
+           delays the count until that process is gone too. */
+static void module_stats_collect_lost_calls(uint32_t *restrict calls_lost, size_t modules_count) {
+  for (size_t i = 0; i < MODULE_STATS_CALLS_COUNT; i++) {
+    struct module_stats_call *call = &module_stats->calls[i];
+
+    int32_t pid = __atomic_load_n(&call->pid, __ATOMIC_ACQUIRE);
+    if (pid == 0 || kill(pid, 0) == 0 || errno != ESRCH) continue;
+
+    uint32_t module = __atomic_load_n(&call->module, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&call->module, UINT32_MAX, __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&call->pid, &pid, 0, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) continue;
+
+    if (module < modules_count) calls_lost[module]++;
+  }
+}
+
+bool module_quarantine_update(void) {
+  static uint64_t last_check_us = 0;
+
+  size_t modules_count = module_stats_modules_count();
+  if (modules_count == 0) return false;
+
+  uint64_t now_us = stats_now_us();
+  if (last_check_us != 0 && now_us - last_check_us < MODULE_QUARANTINE_CHECK_INTERVAL_US) return false;
+
+  last_check_us = now_us;
+
+  uint32_t *calls_lost = calloc(modules_count, sizeof(uint32_t));
+  if (calls_lost == NULL) {
+    LOGE("Failed to allocate lost callback counts");
+
+    return false;
+  }
+
+  module_stats_collect_lost_calls(calls_lost, modules_count);
+
+  bool changed = false;
+  for (size_t i = 0; i < modules_count; i++) {
+    struct module_stats_module *shared = &module_stats->modules[i];
+    struct module_quarantine *quarantine = &module_quarantines[i];
+
+    uint32_t over_budget = __atomic_load_n(&shared->over_budget, __ATOMIC_RELAXED);
+    uint32_t new_calls_lost = calls_lost[i];
+    uint32_t new_over_budget = over_budget - quarantine->over_budget_seen;
+
+    quarantine->over_budget_seen = over_budget;
+
+    if (quarantine->reason != MODULE_QUARANTINE_NONE) {
+      if (now_us < quarantine->released_at_us) continue;
+
+      LOGI("Releasing module %zu from quarantine", i);
+
+      quarantine->reason = MODULE_QUARANTINE_NONE;
+      __atomic_store_n(&shared->quarantined, 0, __ATOMIC_RELEASE);
+
+      changed = true;
+
+      continue;
+    }
+
+    if (new_calls_lost != 0) {
+      LOGW("Module %zu had %u callback(s) that never returned", i, new_calls_lost);
+
+      module_quarantine_strike(i, quarantine, MODULE_QUARANTINE_CRASHED, new_calls_lost, now_us);
+    }
+
+    if (quarantine->reason == MODULE_QUARANTINE_NONE && new_over_budget != 0) {
+      LOGW("Module %zu went over the callback budget %u time(s)", i, new_over_budget);
+
+      module_quarantine_strike(i, quarantine, MODULE_QUARANTINE_OVER_BUDGET, new_over_budget, now_us);
+    }
+
+    if (quarantine->reason != MODULE_QUARANTINE_NONE) changed = true;
+  }
+
+  free(calls_lost);
+
+  return changed;
+}
+
+enum module_quarantine_reason module_quarantine_get(size_t module, uint32_t *restrict left_s) {
+  *left_s = 0;
+
+  if (module >= module_stats_modules_count()) return MODULE_QUARANTINE_NONE;
+
+  const struct module_quarantine *quarantine = &module_quarantines[module];
+  if (quarantine->reason == MODULE_QUARANTINE_NONE) return MODULE_QUARANTINE_NONE;
+
+  uint64_t now_us = stats_now_us();
+  if (now_us < quarantine->released_at_us) *left_s = (uint32_t)((quarantine->released_at_us - now_us) / 1000000);
+
+  return quarantine->reason;
+}
+
+const char *module_quarantine_reason_name(enum module_quarantine_reason reason) {
+  switch (reason) {
+    case MODULE_QUARANTINE_NONE:        return "none";
+    case MODULE_QUARANTINE_OVER_BUDGET: return "over budget";
+    case MODULE_QUARANTINE_CRASHED:     return "crashed";
+  }
+
+  return "Unknown";
+}
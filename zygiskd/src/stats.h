@@ -0,0 +1,129 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "constants.h"
+
+/* INFO: Bucket 0 holds calls under 1us, bucket i holds [2^(i - 1), 2^i) us and the
+           last one everything from 2^(STATS_BUCKETS - 2) us (~262ms) onwards. */
+#define STATS_BUCKETS 20
+
+enum stats_event {
+  /* INFO: Events from 0 up to GetModuleRelro are the DaemonSocketAction values themselves */
+  STATS_ACTIONS_COUNT = GetModuleRelro + 1,
+  STATS_ROOT_BACKEND = STATS_ACTIONS_COUNT,
+  STATS_MNS_BUILD,
+  STATS_COMPANION_SPAWN,
+  STATS_EVENTS_COUNT
+};
+
+struct stats_entry {
+  uint64_t count;
+  uint64_t total_us;
+  uint64_t max_us;
+  uint32_t buckets[STATS_BUCKETS];
+};
+
+/* INFO: Timings of the Zygisk callbacks of each module, recorded by Zygote children
+           straight into a memfd shared with ReZygiskd, so that reporting them costs
+           no request. Must be kept in sync with loader/src/injector/module_stats.h */
+#define MODULE_STATS_MAGIC 0x534d5a52 /* INFO: "RZMS" */
+#define MODULE_STATS_VERSION 3
+
+/* INFO: How many callbacks, each in a different child, can be tracked at once */
+#define MODULE_STATS_CALLS_COUNT 64
+
+enum module_stats_phase {
+  MODULE_STATS_ON_LOAD,
+  MODULE_STATS_PRE,
+  MODULE_STATS_POST,
+  MODULE_STATS_PHASES_COUNT
+};
+
+/* INFO: A callback running in a child, claimed by it before the callback and
+           released once it returns. One still held by a child that is gone is a
+           callback that never returned. */
+struct module_stats_call {
+  /* INFO: 0 if the slot is free */
+  int32_t pid;
+  /* INFO: UINT32_MAX until the claiming child sets it */
+  uint32_t module;
+};
+
+struct module_stats_module {
+  /* INFO: Callbacks that took longer than the budget */
+  uint32_t over_budget;
+  /* INFO: Set by ReZygiskd, children neither run nor keep the module while set */
+  uint32_t quarantined;
+  struct stats_entry phases[MODULE_STATS_PHASES_COUNT];
+};
+
+struct module_stats_buffer {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t modules_count;
+  uint32_t buckets_count;
+  /* INFO: Time a single callback may take, 0 if unlimited */
+  uint32_t budget_us;
+  uint32_t reserved;
+  struct module_stats_call calls[MODULE_STATS_CALLS_COUNT];
+  struct module_stats_module modules[];
+};
+
+enum module_quarantine_reason {
+  MODULE_QUARANTINE_NONE,
+  MODULE_QUARANTINE_OVER_BUDGET,
+  MODULE_QUARANTINE_CRASHED
+};
+
+/* INFO: Summary of a module sent to the monitor. Must be kept in sync with
+           loader/src/ptracer/monitor.h */
+struct module_stats_report {
+  uint64_t count[MODULE_STATS_PHASES_COUNT];
+  uint64_t total_us[MODULE_STATS_PHASES_COUNT];
+  uint64_t max_us[MODULE_STATS_PHASES_COUNT];
+  /* INFO: enum module_quarantine_reason, NONE if the module is not quarantined */
+  uint32_t quarantine_reason;
+  /* INFO: Seconds until the module is released */
+  uint32_t quarantine_left_s;
+};
+
+uint64_t stats_now_us(void);
+
+void stats_record(enum stats_event event, uint64_t start_us);
+
+const struct stats_entry *stats_get(enum stats_event event);
+
+const char *stats_event_name(enum stats_event event);
+
+void module_stats_init(size_t modules_count);
+
+/* INFO: Returns -1 if the buffer could not be created */
+int module_stats_get_fd(void);
+
+size_t module_stats_modules_count(void);
+
+/* INFO: Copy of the entry, as children update it concurrently */
+void module_stats_get(size_t module, enum module_stats_phase phase, struct stats_entry *entry);
+
+/* INFO: Sum of the calls of every module, to tell whether anything changed */
+uint64_t module_stats_total_count(void);
+
+/* INFO: Keeps the entries in line with the module list ReZygiskd compacts */
+void module_stats_remove(size_t module);
+
+/* INFO: Quarantines modules that children reported going over budget or crashing
+           in, and releases those whose cool-down is over. Returns whether any
+           module changed state. */
+bool module_quarantine_update(void);
+
+enum module_quarantine_reason module_quarantine_get(size_t module, uint32_t *restrict left_s);
+
+const char *module_quarantine_reason_name(enum module_quarantine_reason reason);
+
+const char *module_stats_phase_name(enum module_stats_phase phase);
+
+#endif /* STATS_H */
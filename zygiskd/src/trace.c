@@ -0,0 +1,90 @@
+#include <string.h>
+#include <time.h>
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/system_properties.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#include "utils.h"
+
+#ifndef MFD_CLOEXEC
+  #define MFD_CLOEXEC 0x0001U
+#endif
+
+#define TRACE_NO_MODULE 0xffff
+
+static int trace_fd = -1;
+static struct trace_buffer *trace = NULL;
+
+void trace_init(void) {
+  char value[PROP_VALUE_MAX];
+  get_property("persist.rezygisk.trace", value);
+
+  uint32_t flags = 0;
+  if (strcmp(value, "2") == 0) flags = TRACE_FLAG_MEMORY;
+  else if (strcmp(value, "1") != 0) return;
+
+  /* INFO: API 25 bionic has no memfd_create wrapper */
+  int fd = (int)syscall(__NR_memfd_create, "rezygisk-trace", MFD_CLOEXEC);
+  if (fd == -1) {
+    LOGE("Failed to create trace buffer: %s", strerror(errno));
+
+    return;
+  }
+
+  if (ftruncate(fd, (off_t)TRACE_BUFFER_SIZE) == -1) {
+    LOGE("Failed to resize trace buffer: %s", strerror(errno));
+
+    close(fd);
+
+    return;
+  }
+
+  struct trace_buffer *buffer = mmap(NULL, TRACE_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (buffer == MAP_FAILED) {
+    LOGE("Failed to map trace buffer: %s", strerror(errno));
+
+    close(fd);
+
+    return;
+  }
+
+  buffer->magic = TRACE_MAGIC;
+  buffer->version = TRACE_VERSION;
+  buffer->capacity = TRACE_CAPACITY;
+  buffer->flags = flags;
+  buffer->head = 0;
+
+  trace_fd = fd;
+  trace = buffer;
+
+  LOGI("Spawn tracing enabled%s", flags & TRACE_FLAG_MEMORY ? ", with memory sampling" : "");
+}
+
+int trace_get_fd(void) {
+  return trace_fd;
+}
+
+void trace_append(pid_t pid, enum trace_event_type type, uint32_t arg) {
+  if (trace == NULL) return;
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  uint32_t index = __atomic_fetch_add(&trace->head, 1, __ATOMIC_RELAXED);
+  struct trace_event *event = &trace->events[index % TRACE_CAPACITY];
+
+  __atomic_store_n(&event->seq, 0, __ATOMIC_RELAXED);
+
+  event->pid = pid;
+  event->timestamp_ns = (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+  event->type = (uint16_t)type;
+  event->module = TRACE_NO_MODULE;
+  event->arg = arg;
+
+  __atomic_store_n(&event->seq, index + 1, __ATOMIC_RELEASE);
+}
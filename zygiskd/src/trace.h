@@ -0,0 +1,69 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#include <sys/types.h>
+
+/* INFO: Must be kept in sync with loader/src/include/trace.h */
+
+#define TRACE_MAGIC 0x5254525a /* INFO: "ZRTR" */
+#define TRACE_VERSION 2
+
+/* INFO: Must be a power of two, so that the 32-bit head wraps onto the same slot */
+#define TRACE_CAPACITY 4096
+
+enum trace_event_type {
+  TRACE_FORK = 1,
+  TRACE_FLAGS_QUERY_SENT,
+  TRACE_FLAGS_QUERY_RECEIVED,
+  TRACE_DAEMON_FLAGS_QUERY,
+  TRACE_DAEMON_FLAGS_REPLY,
+  TRACE_SETNS,
+  TRACE_MODULES_PRE_START,
+  TRACE_MODULE_PRE_DONE,
+  TRACE_MODULES_POST_START,
+  TRACE_MODULE_POST_DONE,
+  TRACE_MODULES_UNLOADED,
+  TRACE_FDS_SANITIZED,
+  TRACE_SELF_UNLOAD,
+  TRACE_MEM_SAMPLE,
+  TRACE_MEM_PSS,
+  TRACE_MEM_PRIVATE_DIRTY
+};
+
+/* INFO: Children also sample their memory use, which costs a /proc/self/smaps walk per sample */
+#define TRACE_FLAG_MEMORY 0x1
+
+struct trace_event {
+  /* INFO: Slot index + 1, stored last, so that readers can skip slots still being written */
+  uint32_t seq;
+  int32_t pid;
+  uint64_t timestamp_ns;
+  uint16_t type;
+  uint16_t module;
+  uint32_t arg;
+};
+
+struct trace_buffer {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t capacity;
+  uint32_t flags;
+  uint32_t head;
+  uint32_t reserved;
+  struct trace_event events[];
+};
+
+#define TRACE_BUFFER_SIZE (sizeof(struct trace_buffer) + TRACE_CAPACITY * sizeof(struct trace_event))
+
+/* INFO: Creates the buffer if persist.rezygisk.trace is set to 1, or to 2 for
+           memory sampling as well */
+void trace_init(void);
+
+/* INFO: Returns -1 if tracing is disabled */
+int trace_get_fd(void);
+
+void trace_append(pid_t pid, enum trace_event_type type, uint32_t arg);
+
+#endif /* TRACE_H */
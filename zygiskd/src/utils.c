@@ -307,6 +307,9 @@ read_func(uint32_t)
 write_func(uint8_t)
 read_func(uint8_t)
 
+write_func(uint64_t)
+read_func(uint64_t)
+
 ssize_t write_string(int fd, const char *restrict str) {
   size_t str_len = strlen(str);
   ssize_t written_bytes = write(fd, &str_len, sizeof(size_t));
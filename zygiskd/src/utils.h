@@ -7,6 +7,7 @@
 #include <android/log.h>
 
 #include "constants.h"
+#include "log.h"
 #include "root_impl/common.h"
 
 #define CONCAT_(x,y) x##y
@@ -22,17 +23,11 @@
   #define LOG_TAG "zygiskd" LP_SELECT("32", "64")
 #endif
 
-#define LOGI(...)                                              \
-  __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__); \
-  printf(__VA_ARGS__)
-
-#define LOGW(...)                                                \
-  __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__);   \
-  printf(__VA_ARGS__)
-
-#define LOGE(...)                                                \
-  __android_log_print(ANDROID_LOG_ERROR , LOG_TAG, __VA_ARGS__); \
-  printf(__VA_ARGS__)
+#define LOGV(...) ZYGISKD_LOG(ANDROID_LOG_VERBOSE, LOG_TAG, __VA_ARGS__)
+#define LOGD(...) ZYGISKD_LOG(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define LOGI(...) ZYGISKD_LOG(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGW(...) ZYGISKD_LOG(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) ZYGISKD_LOG(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
 
 #define ASSURE_SIZE_WRITE(area_name, subarea_name, sent_size, expected_size, return_type)                        \
   if (sent_size != (ssize_t)(expected_size)) {                                                                   \
@@ -81,6 +76,9 @@ read_func_def(uint32_t);
 write_func_def(uint8_t);
 read_func_def(uint8_t);
 
+write_func_def(uint64_t);
+read_func_def(uint64_t);
+
 ssize_t write_string(int fd, const char *restrict str);
 
 ssize_t read_string(int fd, char *restrict buf, size_t buf_size);
@@ -5,20 +5,27 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/wait.h>
 
 #include <linux/limits.h>
 #include <unistd.h>
 
+#include "boot_cache.h"
 #include "constants.h"
+#include "relro.h"
 #include "root_impl/common.h"
+#include "stats.h"
+#include "trace.h"
 #include "utils.h"
 
 struct Module {
   char *name;
   int lib_fd;
   int companion;
+  char *targets;
+  struct module_relro relro;
 };
 
 struct Context {
@@ -47,10 +54,178 @@ struct Context {
 #endif
 
 /* WARNING: Dynamic memory based */
+/* INFO: A module directory changes whenever a file like "disable" is created in it, and its
+           "zygisk" directory whenever a library is added or removed, so together with
+           the libraries themselves they cover everything the scan decides upon. */
+static uint64_t modules_fingerprint(const struct boot_cache_module *modules, size_t len) {
+  uint64_t hash = boot_cache_hash_path(BOOT_CACHE_HASH_INIT, PATH_MODULES_DIR, false);
+
+  for (size_t i = 0; i < len; i++) {
+    char path[PATH_MAX];
+    snprintf(path, PATH_MAX, PATH_MODULES_DIR "/%s", modules[i].name);
+    hash = boot_cache_hash_path(hash, path, false);
+
+    snprintf(path, PATH_MAX, PATH_MODULES_DIR "/%s/zygisk", modules[i].name);
+    hash = boot_cache_hash_path(hash, path, false);
+
+    if (!modules[i].loadable) continue;
+
+    snprintf(path, PATH_MAX, PATH_MODULES_DIR "/%s/zygisk/" ARCH_STR ".so", modules[i].name);
+    hash = boot_cache_hash_path(hash, path, false);
+  }
+
+  return hash;
+}
+
+#define MODULE_TARGETS_MAX_SIZE 4096
+
+/* INFO: A module may list the processes it is meant for in "zygisk/targets", one glob
+           per line, "system_server" included, with "#" starting a comment. The globs
+           are returned separated by newlines, or NULL if the module targets every
+           process, so that libzygisk only loads it in the processes it targets. */
+static char *read_module_targets(const char *name) {
+  char path[PATH_MAX];
+  snprintf(path, PATH_MAX, PATH_MODULES_DIR "/%s/zygisk/targets", name);
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return NULL;
+
+  char buf[MODULE_TARGETS_MAX_SIZE];
+  ssize_t len = read(fd, buf, sizeof(buf) - 1);
+
+  bool truncated = (size_t)len == sizeof(buf) - 1 && read(fd, &(char){ 0 }, 1) == 1;
+  close(fd);
+
+  if (len == -1) {
+    LOGE("Failed reading targets of module \"%s\": %s", name, strerror(errno));
+
+    return NULL;
+  }
+
+  buf[len] = '\0';
+
+  /* INFO: The last line was cut, and half a glob could match other processes */
+  if (truncated) {
+    while (len > 0 && buf[len - 1] != '\n') len--;
+
+    LOGW("Targets of module \"%s\" exceed %zu bytes, ignoring them from line \"%.32s\"", name, sizeof(buf) - 1, buf + len);
+
+    buf[len] = '\0';
+  }
+
+  char *targets = malloc((size_t)len + 1);
+  if (targets == NULL) {
+    LOGE("Failed allocating memory for targets of module \"%s\".", name);
+
+    return NULL;
+  }
+
+  size_t targets_len = 0;
+  char *saveptr = NULL;
+  for (char *line = strtok_r(buf, "\n", &saveptr); line != NULL; line = strtok_r(NULL, "\n", &saveptr)) {
+    char *comment = strchr(line, '#');
+    if (comment) *comment = '\0';
+
+    while (*line == ' ' || *line == '\t') line++;
+
+    size_t line_len = strlen(line);
+    while (line_len > 0 && (line[line_len - 1] == ' ' || line[line_len - 1] == '\t' || line[line_len - 1] == '\r')) line_len--;
+
+    if (line_len == 0) continue;
+
+    if (targets_len != 0) targets[targets_len++] = '\n';
+    memcpy(targets + targets_len, line, line_len);
+    targets_len += line_len;
+  }
+
+  targets[targets_len] = '\0';
+
+  /* INFO: An empty filter would match no process, leaving the module loaded for none */
+  if (targets_len == 0) {
+    LOGW("Targets of module \"%s\" have no pattern, loading it for every process", name);
+
+    free(targets);
+
+    return NULL;
+  }
+
+  return targets;
+}
+
+/* INFO: Returns false only when out of memory, in which case all modules are unloaded */
+static bool load_module(struct Context *restrict context, const char *name) {
+  char so_path[PATH_MAX];
+  snprintf(so_path, PATH_MAX, "/data/adb/modules/%s/zygisk/" ARCH_STR ".so", name);
+
+  int lib_fd = open(so_path, O_RDONLY | O_CLOEXEC);
+  if (lib_fd == -1) {
+    LOGE("Failed loading module \"%s\"", name);
+
+    return true;
+  }
+
+  struct Module *tmp_modules = realloc(context->modules, (context->len + 1) * sizeof(struct Module));
+  if (tmp_modules == NULL) {
+    LOGE("Failed reallocating memory for modules.");
+
+    close(lib_fd);
+
+    for (size_t i = 0; i < context->len; i++) {
+      free(context->modules[i].name);
+      free(context->modules[i].targets);
+      if (context->modules[i].companion >= 0) close(context->modules[i].companion);
+      module_relro_reset(&context->modules[i].relro);
+      if (context->modules[i].lib_fd >= 0) close(context->modules[i].lib_fd);
+    }
+
+    free(context->modules);
+    context->modules = NULL;
+    context->len = 0;
+
+    return false;
+  }
+  context->modules = tmp_modules;
+
+  context->modules[context->len].name = strdup(name);
+  if (context->modules[context->len].name == NULL) {
+    LOGE("Failed to strdup for the module \"%s\": %s", name, strerror(errno));
+
+    close(lib_fd);
+
+    return false;
+  }
+
+  context->modules[context->len].lib_fd = lib_fd;
+  context->modules[context->len].companion = -1;
+  context->modules[context->len].targets = read_module_targets(name);
+  module_relro_init(&context->modules[context->len].relro);
+  context->len++;
+
+  return true;
+}
+
 static void load_modules(struct Context *restrict context) {
   context->len = 0;
   context->modules = NULL;
 
+  LOGI("Loading modules for architecture: " ARCH_STR);
+
+  uint64_t cached_fingerprint;
+  const struct boot_cache_module *cached_modules = NULL;
+  size_t cached_len = 0;
+  if (boot_cache_get_modules(&cached_fingerprint, &cached_modules, &cached_len) &&
+      modules_fingerprint(cached_modules, cached_len) == cached_fingerprint) {
+    LOGI("Using cached modules scan results\n");
+
+    for (size_t i = 0; i < cached_len; i++) {
+      if (!cached_modules[i].loadable) continue;
+
+      if (!load_module(context, cached_modules[i].name)) return;
+    }
+
+    return;
+  }
+
   DIR *dir = opendir(PATH_MODULES_DIR);
   if (dir == NULL) {
     LOGE("Failed opening modules directory: %s.", PATH_MODULES_DIR);
@@ -58,7 +233,11 @@ static void load_modules(struct Context *restrict context) {
     return;
   }
 
-  LOGI("Loading modules for architecture: " ARCH_STR);
+  /* INFO: Every module directory is recorded, loadable or not, so that the next
+             boot can tell if any of them changed without listing them again. */
+  struct boot_cache_module *scanned = NULL;
+  size_t scanned_len = 0;
+  bool scan_cacheable = true;
 
   struct dirent *entry;
   while ((entry = readdir(dir)) != NULL) {
@@ -66,6 +245,27 @@ static void load_modules(struct Context *restrict context) {
     if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 || strcmp(entry->d_name, "rezygisk") == 0) continue;
 
     char *name = entry->d_name;
+
+    struct boot_cache_module *scanned_module = NULL;
+    if (scan_cacheable) {
+      struct boot_cache_module *tmp_scanned = realloc(scanned, (scanned_len + 1) * sizeof(struct boot_cache_module));
+      if (tmp_scanned == NULL) {
+        LOGE("Failed reallocating memory for the modules cache.");
+
+        free(scanned);
+        scanned = NULL;
+        scanned_len = 0;
+        scan_cacheable = false;
+      } else {
+        scanned = tmp_scanned;
+        scanned_module = &scanned[scanned_len++];
+
+        strncpy(scanned_module->name, name, sizeof(scanned_module->name) - 1);
+        scanned_module->name[sizeof(scanned_module->name) - 1] = '\0';
+        scanned_module->loadable = 0;
+      }
+    }
+
     char so_path[PATH_MAX];
     snprintf(so_path, PATH_MAX, "/data/adb/modules/%s/zygisk/" ARCH_STR ".so", name);
 
@@ -76,62 +276,58 @@ static void load_modules(struct Context *restrict context) {
 
     if (access(disabled, F_OK) == 0) continue;
 
-    int lib_fd = open(so_path, O_RDONLY | O_CLOEXEC);
-    if (lib_fd == -1) {
-      LOGE("Failed loading module \"%s\"", name);
+    if (scanned_module) scanned_module->loadable = 1;
 
-      continue;
-    }
-
-    struct Module *tmp_modules = realloc(context->modules, (context->len + 1) * sizeof(struct Module));
-    if (tmp_modules == NULL) {
-      LOGE("Failed reallocating memory for modules.");
-
-      close(lib_fd);
-
-      for (size_t i = 0; i < context->len; i++) {
-        free(context->modules[i].name);
-        if (context->modules[i].companion >= 0) close(context->modules[i].companion);
-        if (context->modules[i].lib_fd >= 0) close(context->modules[i].lib_fd);
-      }
-
-      free(context->modules);
-      context->modules = NULL;
-      context->len = 0;
+    if (!load_module(context, name)) {
+      free(scanned);
 
       closedir(dir);
 
       return;
     }
-    context->modules = tmp_modules;
-
-    context->modules[context->len].name = strdup(name);
-    if (context->modules[context->len].name == NULL) {
-      LOGE("Failed to strdup for the module \"%s\": %s", name, strerror(errno));
-
-      close(lib_fd);
-
-      return;
-    }
-
-    context->modules[context->len].lib_fd = lib_fd;
-    context->modules[context->len].companion = -1;
-    context->len++;
   }
 
   closedir(dir);
+
+  if (scan_cacheable) boot_cache_set_modules(modules_fingerprint(scanned, scanned_len), scanned, scanned_len);
 }
 
 static void free_modules(struct Context *restrict context) {
   for (size_t i = 0; i < context->len; i++) {
     free(context->modules[i].name);
+    free(context->modules[i].targets);
     if (context->modules[i].companion >= 0) close(context->modules[i].companion);
+    module_relro_reset(&context->modules[i].relro);
     if (context->modules[i].lib_fd >= 0) close(context->modules[i].lib_fd);
   }
 
   free(context->modules);
 }
 
+/* INFO: Zygote only reports that it was injected once all boot mounts are done, so
+           this is the earliest moment where the namespaces can be built without
+           missing mounts. Building them ahead, instead of in the first app process,
+           removes a fork and the whole umount process from its startup. */
+static void prebuild_mns_fds(pid_t zygote_pid, struct root_impl impl) {
+  uint64_t mns_start = stats_now_us();
+
+  if (save_mns_fd(zygote_pid, Mounted, impl) == -1) {
+    LOGE("Failed to prebuild mounted namespace from Zygote %d", zygote_pid);
+
+    return;
+  }
+
+  if (save_mns_fd(zygote_pid, Clean, impl) == -1) {
+    LOGE("Failed to prebuild clean namespace from Zygote %d", zygote_pid);
+
+    return;
+  }
+
+  stats_record(STATS_MNS_BUILD, mns_start);
+
+  LOGI("Prebuilt mount namespaces from Zygote %d", zygote_pid);
+}
+
 static int create_daemon_socket(void) {
   set_socket_create_context("u:r:zygote:s0");
 
@@ -257,6 +453,80 @@ static int spawn_companion(char *restrict argv[], char *restrict name, int lib_f
   exit(0);
 }
 
+#define MODULE_STATS_REPORT_INTERVAL_US (10 * 1000000)
+
+/* INFO: Children record module timings without talking to ReZygiskd, so they are
+           forwarded to the monitor from here, for state.json. Checked after each
+           request, sent at most every MODULE_STATS_REPORT_INTERVAL_US, and only if
+           a callback ran since the last report. Quarantine changes are sent at once. */
+static void report_module_stats(const struct Context *restrict context) {
+  static uint64_t last_report_us = 0;
+  static uint64_t last_total_count = 0;
+
+  bool quarantine_changed = module_quarantine_update();
+
+  uint64_t now_us = stats_now_us();
+  if (!quarantine_changed && last_report_us != 0 && now_us - last_report_us < MODULE_STATS_REPORT_INTERVAL_US) return;
+
+  uint64_t total_count = module_stats_total_count();
+  if (!quarantine_changed && total_count == last_total_count) return;
+
+  last_report_us = now_us;
+  last_total_count = total_count;
+
+  size_t modules_len = module_stats_modules_count();
+  if (modules_len > context->len) modules_len = context->len;
+
+  /* INFO: The whole report goes in a single datagram, led by the command, so that it
+             can neither interleave with the other ReZygiskd's nor arrive partially. */
+  size_t buf_len = sizeof(uint8_t) + sizeof(uint32_t);
+  for (size_t i = 0; i < modules_len; i++) {
+    buf_len += sizeof(uint32_t) + strlen(context->modules[i].name) + sizeof(struct module_stats_report);
+  }
+
+  uint8_t *buf = malloc(buf_len);
+  if (buf == NULL) {
+    LOGE("Failed allocating memory for module stats report");
+
+    return;
+  }
+
+  size_t offset = 0;
+  buf[offset++] = DAEMON_SET_MODULE_STATS;
+
+  uint32_t report_len = (uint32_t)modules_len;
+  memcpy(buf + offset, &report_len, sizeof(report_len));
+  offset += sizeof(report_len);
+
+  for (size_t i = 0; i < modules_len; i++) {
+    struct module_stats_report report;
+    for (size_t phase = 0; phase < MODULE_STATS_PHASES_COUNT; phase++) {
+      struct stats_entry entry;
+      module_stats_get(i, (enum module_stats_phase)phase, &entry);
+
+      report.count[phase] = entry.count;
+      report.total_us[phase] = entry.total_us;
+      report.max_us[phase] = entry.max_us;
+    }
+
+    report.quarantine_reason = (uint32_t)module_quarantine_get(i, &report.quarantine_left_s);
+
+    uint32_t module_name_len = (uint32_t)strlen(context->modules[i].name);
+    memcpy(buf + offset, &module_name_len, sizeof(module_name_len));
+    offset += sizeof(module_name_len);
+
+    memcpy(buf + offset, context->modules[i].name, module_name_len);
+    offset += module_name_len;
+
+    memcpy(buf + offset, &report, sizeof(report));
+    offset += sizeof(report);
+  }
+
+  unix_datagram_sendto(CONTROLLER_SOCKET, buf, buf_len);
+
+  free(buf);
+}
+
 /* WARNING: Dynamic memory based */
 void zygiskd_start(char *restrict argv[]) {
   /* INFO: When implementation is None or Multiple, it won't set the values
@@ -279,10 +549,14 @@ void zygiskd_start(char *restrict argv[]) {
     unix_datagram_sendto(CONTROLLER_SOCKET, &msg_len, sizeof(msg_len));
     unix_datagram_sendto(CONTROLLER_SOCKET, msg, msg_len);
 
+    boot_cache_save();
+
     exit(EXIT_FAILURE);
   } else {
     load_modules(&context);
 
+    boot_cache_save();
+
     unix_datagram_sendto(CONTROLLER_SOCKET, &(uint8_t){ DAEMON_SET_INFO }, sizeof(uint8_t));
 
     char impl_name[LONGEST_ROOT_IMPL_NAME];
@@ -318,8 +592,30 @@ void zygiskd_start(char *restrict argv[]) {
   struct sigaction sa = { .sa_handler = SIG_IGN };
   sigaction(SIGPIPE, &sa, NULL);
 
+  trace_init();
+  module_stats_init(context.len);
+
+  /* INFO: ReZygiskd is started by the monitor before Zygote even exists, so that
+             the root implementation detection and module scan above are out of
+             Zygote's startup path. Only now, with the socket listening, it is
+             ready to serve Zygote. */
+  unix_datagram_sendto(CONTROLLER_SOCKET, &(uint8_t){ DAEMON_SET_READY }, sizeof(uint8_t));
+
   bool first_process = true;
+  pid_t mns_prebuild_pid = 0;
   while (1) {
+    /* INFO: The loop serves one client at a time, so the namespaces are only built
+               once no request is waiting, to not hold back Zygote's requests right
+               after it is injected. A request needing them first builds them itself. */
+    if (mns_prebuild_pid != 0) {
+      struct pollfd pfd = { .fd = socket_fd, .events = POLLIN };
+      if (poll(&pfd, 1, 0) == 0) {
+        prebuild_mns_fds(mns_prebuild_pid, impl);
+
+        mns_prebuild_pid = 0;
+      }
+    }
+
     int client_fd = accept(socket_fd, NULL, NULL);
     if (client_fd == -1) {
       LOGE("accept: %s", strerror(errno));
@@ -345,13 +641,34 @@ void zygiskd_start(char *restrict argv[]) {
 
     enum DaemonSocketAction action = (enum DaemonSocketAction)action8;
 
+    uint64_t action_start = stats_now_us();
+
     switch (action) {
       case ZygoteInjected: {
         unix_datagram_sendto(CONTROLLER_SOCKET, &(uint8_t){ ZYGOTE_INJECTED }, sizeof(uint8_t));
 
+        /* INFO: As ReZygiskd may have started before init switched to its default mount
+                   namespace, re-enter it now that Zygote is up, so that companions are
+                   spawned with the same view as before. */
+        if (!switch_mount_namespace(1))
+          LOGE("Failed to re-enter init mount namespace");
+
+        struct ucred cred;
+        socklen_t cred_len = sizeof(cred);
+        if (getsockopt(client_fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == -1) {
+          LOGE("Failed to get Zygote credentials: %s", strerror(errno));
+
+          break;
+        }
+
+        mns_prebuild_pid = cred.pid;
+
         break;
       }
       case ZygoteRestart: {
+        /* INFO: The old Zygote is gone, and the new one reports itself once injected */
+        mns_prebuild_pid = 0;
+
         for (size_t i = 0; i < context.len; i++) {
           if (context.modules[i].companion <= -1) continue;
 
@@ -359,6 +676,11 @@ void zygiskd_start(char *restrict argv[]) {
           context.modules[i].companion = -1;
         }
 
+        /* INFO: The new Zygote maps the modules somewhere else */
+        for (size_t i = 0; i < context.len; i++) {
+          module_relro_reset(&context.modules[i].relro);
+        }
+
         break;
       }
       case GetProcessFlags: {
@@ -375,6 +697,17 @@ void zygiskd_start(char *restrict argv[]) {
           break;
         }
 
+        /* INFO: Events are recorded under the requesting process, so that they show up
+                   in its timeline. Only looked up when tracing is enabled. */
+        pid_t client_pid = 0;
+        if (trace_get_fd() != -1) {
+          struct ucred cred;
+          socklen_t cred_len = sizeof(cred);
+          if (getsockopt(client_fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == 0) client_pid = cred.pid;
+
+          trace_append(client_pid, TRACE_DAEMON_FLAGS_QUERY, uid);
+        }
+
         uint32_t flags = 0;
         if (first_process) {
           flags |= PROCESS_IS_FIRST_STARTED;
@@ -382,6 +715,8 @@ void zygiskd_start(char *restrict argv[]) {
           first_process = false;
         }
 
+        uint64_t root_start = stats_now_us();
+
         if (uid_is_manager(uid)) {
           flags |= PROCESS_IS_MANAGER;
         } else {
@@ -393,6 +728,8 @@ void zygiskd_start(char *restrict argv[]) {
           }
         }
 
+        stats_record(STATS_ROOT_BACKEND, root_start);
+
         switch (impl.impl) {
           case None: { break; }
           case Multiple: { break; }
@@ -413,6 +750,8 @@ void zygiskd_start(char *restrict argv[]) {
           }
         }
 
+        trace_append(client_pid, TRACE_DAEMON_FLAGS_REPLY, flags);
+
         ret = write_uint32_t(client_fd, flags);
         ASSURE_SIZE_WRITE("GetProcessFlags", "flags", ret, sizeof(flags), break);
 
@@ -478,6 +817,19 @@ void zygiskd_start(char *restrict argv[]) {
 
             break;
           }
+
+          uint8_t has_targets = context.modules[i].targets != NULL;
+          if (write_uint8_t(client_fd, has_targets) == -1) {
+            LOGE("Failed writing module targets presence.");
+
+            break;
+          }
+
+          if (has_targets && write_string(client_fd, context.modules[i].targets) == -1) {
+            LOGE("Failed writing module targets.");
+
+            break;
+          }
         }
 
         break;
@@ -507,8 +859,12 @@ void zygiskd_start(char *restrict argv[]) {
         }
 
         if (module->companion <= -1) {
+          uint64_t spawn_start = stats_now_us();
+
           module->companion = spawn_companion(argv, module->name, module->lib_fd);
 
+          stats_record(STATS_COMPANION_SPAWN, spawn_start);
+
           if (module->companion >= 0) {
             LOGI(" - Spawned companion for \"%s\": %d", module->name, module->companion);
           } else if (module->companion == -2) {
@@ -592,10 +948,14 @@ void zygiskd_start(char *restrict argv[]) {
         ret = write_uint32_t(client_fd, our_pid);
         ASSURE_SIZE_WRITE("UpdateMountNamespace", "our_pid", ret, sizeof(our_pid), break);
 
+        uint64_t mns_start = stats_now_us();
+
         if ((enum MountNamespaceState)mns_state == Clean)
           save_mns_fd(pid, Mounted, impl);
 
         int ns_fd = save_mns_fd(pid, (enum MountNamespaceState)mns_state, impl);
+
+        stats_record(STATS_MNS_BUILD, mns_start);
         if (ns_fd == -1) {
           LOGE("Failed to save mount namespace fd for pid %d: %s", pid, strerror(errno));
 
@@ -611,12 +971,14 @@ void zygiskd_start(char *restrict argv[]) {
         break;
       }
       case RemoveModule: {
-        size_t index = 0;
-        ssize_t ret = read_size_t(client_fd, &index);
-        ASSURE_SIZE_READ("RemoveModule", "index", ret, sizeof(index), break);
+        /* INFO: Indices refer to the module list before any of them is removed, in
+                   increasing order, so that all failures of a load are sent at once. */
+        size_t indices_len = 0;
+        ssize_t ret = read_size_t(client_fd, &indices_len);
+        ASSURE_SIZE_READ("RemoveModule", "indices_len", ret, sizeof(indices_len), break);
 
-        if (index >= context.len) {
-          LOGE("Invalid module index: %zu", index);
+        if (indices_len == 0 || indices_len > context.len) {
+          LOGE("Invalid module indices length: %zu", indices_len);
 
           ret = write_uint8_t(client_fd, 0);
           ASSURE_SIZE_WRITE("RemoveModule", "response", ret, sizeof(uint8_t), break);
@@ -624,31 +986,214 @@ void zygiskd_start(char *restrict argv[]) {
           break;
         }
 
-        struct Module *module = &context.modules[index];
-        if (module->companion >= 0) {
-          close(module->companion);
-          module->companion = -1;
+        size_t *indices = malloc(indices_len * sizeof(size_t));
+        if (!indices) {
+          LOGE("Failed allocating memory for module indices.");
+
+          ret = write_uint8_t(client_fd, 0);
+          ASSURE_SIZE_WRITE("RemoveModule", "response", ret, sizeof(uint8_t), break);
+
+          break;
+        }
+
+        bool valid = true;
+        for (size_t i = 0; i < indices_len; i++) {
+          ret = read_size_t(client_fd, &indices[i]);
+          if (ret != sizeof(size_t)) {
+            LOGE("Failed reading module index.");
+
+            valid = false;
+
+            break;
+          }
+
+          if (indices[i] >= context.len || (i > 0 && indices[i] <= indices[i - 1])) {
+            LOGE("Invalid module index: %zu", indices[i]);
+
+            valid = false;
+
+            break;
+          }
         }
 
-        free(module->name);
-        module->name = NULL;
+        if (!valid) {
+          free(indices);
+
+          ret = write_uint8_t(client_fd, 0);
+          ASSURE_SIZE_WRITE("RemoveModule", "response", ret, sizeof(uint8_t), break);
 
-        if (module->lib_fd >= 0) {
-          close(module->lib_fd);
-          module->lib_fd = -1;
+          break;
         }
 
-        memmove(&context.modules[index], &context.modules[index + 1], (context.len - index - 1) * sizeof(struct Module));
-        context.len--;
+        /* INFO: From the last one, so that the remaining indices stay valid */
+        for (size_t i = indices_len; i-- > 0;) {
+          size_t index = indices[i];
+
+          struct Module *module = &context.modules[index];
+          if (module->companion >= 0) {
+            close(module->companion);
+            module->companion = -1;
+          }
+
+          free(module->name);
+          module->name = NULL;
+
+          free(module->targets);
+          module->targets = NULL;
+
+          module_relro_reset(&module->relro);
+
+          if (module->lib_fd >= 0) {
+            close(module->lib_fd);
+            module->lib_fd = -1;
+          }
+
+          memmove(&context.modules[index], &context.modules[index + 1], (context.len - index - 1) * sizeof(struct Module));
+          context.len--;
+
+          module_stats_remove(index);
+        }
+
+        free(indices);
 
         ret = write_uint8_t(client_fd, 1);
         ASSURE_SIZE_WRITE("RemoveModule", "response", ret, sizeof(uint8_t), break);
 
+        break;
+      }
+      case GetStats: {
+        uint32_t events_len = STATS_EVENTS_COUNT;
+        ssize_t ret = write_uint32_t(client_fd, events_len);
+        ASSURE_SIZE_WRITE("GetStats", "events_len", ret, sizeof(events_len), break);
+
+        uint32_t buckets_len = STATS_BUCKETS;
+        ret = write_uint32_t(client_fd, buckets_len);
+        ASSURE_SIZE_WRITE("GetStats", "buckets_len", ret, sizeof(buckets_len), break);
+
+        for (uint32_t i = 0; i < events_len; i++) {
+          const struct stats_entry *entry = stats_get((enum stats_event)i);
+
+          if (write_string(client_fd, stats_event_name((enum stats_event)i)) == -1) {
+            LOGE("Failed writing stats event name.");
+
+            break;
+          }
+
+          ret = write_uint64_t(client_fd, entry->count);
+          ASSURE_SIZE_WRITE("GetStats", "count", ret, sizeof(entry->count), break);
+
+          ret = write_uint64_t(client_fd, entry->total_us);
+          ASSURE_SIZE_WRITE("GetStats", "total_us", ret, sizeof(entry->total_us), break);
+
+          ret = write_uint64_t(client_fd, entry->max_us);
+          ASSURE_SIZE_WRITE("GetStats", "max_us", ret, sizeof(entry->max_us), break);
+
+          ret = write(client_fd, entry->buckets, sizeof(entry->buckets));
+          ASSURE_SIZE_WRITE("GetStats", "buckets", ret, sizeof(entry->buckets), break);
+        }
+
+        /* INFO: Followed by the callback timings of each module, in the same format */
+        size_t modules_len = module_stats_modules_count();
+        if (modules_len > context.len) modules_len = context.len;
+
+        uint32_t module_entries_len = (uint32_t)(modules_len * MODULE_STATS_PHASES_COUNT);
+        ret = write_uint32_t(client_fd, module_entries_len);
+        ASSURE_SIZE_WRITE("GetStats", "module_entries_len", ret, sizeof(module_entries_len), break);
+
+        for (uint32_t i = 0; i < module_entries_len; i++) {
+          size_t module = i / MODULE_STATS_PHASES_COUNT;
+          enum module_stats_phase phase = (enum module_stats_phase)(i % MODULE_STATS_PHASES_COUNT);
+
+          struct stats_entry entry;
+          module_stats_get(module, phase, &entry);
+
+          char name[PATH_MAX];
+          snprintf(name, sizeof(name), "%s: %s", context.modules[module].name, module_stats_phase_name(phase));
+
+          if (write_string(client_fd, name) == -1) {
+            LOGE("Failed writing module stats name.");
+
+            break;
+          }
+
+          ret = write_uint64_t(client_fd, entry.count);
+          ASSURE_SIZE_WRITE("GetStats", "module count", ret, sizeof(entry.count), break);
+
+          ret = write_uint64_t(client_fd, entry.total_us);
+          ASSURE_SIZE_WRITE("GetStats", "module total_us", ret, sizeof(entry.total_us), break);
+
+          ret = write_uint64_t(client_fd, entry.max_us);
+          ASSURE_SIZE_WRITE("GetStats", "module max_us", ret, sizeof(entry.max_us), break);
+
+          ret = write(client_fd, entry.buckets, sizeof(entry.buckets));
+          ASSURE_SIZE_WRITE("GetStats", "module buckets", ret, sizeof(entry.buckets), break);
+        }
+
+        break;
+      }
+      case GetTraceBuffer: {
+        int fd = trace_get_fd();
+
+        ssize_t ret = write_uint8_t(client_fd, (uint8_t)(fd != -1));
+        ASSURE_SIZE_WRITE("GetTraceBuffer", "enabled", ret, sizeof(uint8_t), break);
+
+        if (fd == -1) break;
+
+        if (write_fd(client_fd, fd) == -1) {
+          LOGE("Failed sending trace buffer fd: %s", strerror(errno));
+
+          break;
+        }
+
+        break;
+      }
+      case GetModuleRelro: {
+        size_t index = 0;
+        ssize_t ret = read_size_t(client_fd, &index);
+        ASSURE_SIZE_READ("GetModuleRelro", "index", ret, sizeof(index), break);
+
+        int fd = -1;
+        enum module_relro_role role = MODULE_RELRO_UNAVAILABLE;
+        if (index < context.len) role = module_relro_get(&context.modules[index].relro, &fd);
+        else LOGE("Invalid module index: %zu", index);
+
+        ret = write_uint8_t(client_fd, (uint8_t)role);
+        ASSURE_SIZE_WRITE("GetModuleRelro", "role", ret, sizeof(uint8_t), break);
+
+        if (role == MODULE_RELRO_UNAVAILABLE) break;
+
+        if (write_fd(client_fd, fd) == -1) {
+          LOGE("Failed sending module RELRO fd: %s", strerror(errno));
+
+          break;
+        }
+
+        break;
+      }
+      case GetModuleStatsBuffer: {
+        int fd = module_stats_get_fd();
+
+        ssize_t ret = write_uint8_t(client_fd, (uint8_t)(fd != -1));
+        ASSURE_SIZE_WRITE("GetModuleStatsBuffer", "available", ret, sizeof(uint8_t), break);
+
+        if (fd == -1) break;
+
+        if (write_fd(client_fd, fd) == -1) {
+          LOGE("Failed sending module stats buffer fd: %s", strerror(errno));
+
+          break;
+        }
+
         break;
       }
     }
 
+    /* INFO: Unknown actions would otherwise land on the events past the actions */
+    if (action8 < STATS_ACTIONS_COUNT) stats_record((enum stats_event)action, action_start);
+
     close(client_fd);
+
+    report_module_stats(&context);
   }
 
   close(socket_fd);